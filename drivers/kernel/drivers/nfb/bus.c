@@ -133,28 +133,16 @@ struct nfb_device *nfb_comp_get_device(struct nfb_comp *comp)
 int nfb_comp_trylock(struct nfb_comp *comp, uint32_t features, int timeout)
 {
 	int ret;
-	int cnt = 0;
 	struct nfb_lock lock;
 
 	lock.path = comp->path;
 	lock.features = features;
 
-	do {
-		ret = nfb_lock_try_lock(comp->nfb, &comp->nfb->kernel_app, lock);
-		if (ret == 0) {
-			return ret;
-		} else if (ret != -EBUSY) {
-			return ret;
-		} else if (timeout == 0) {
-			return -EBUSY;
-		} else {
-			udelay(50);
-		}
-	} while (timeout * 20 > cnt++);
-
-	dev_warn(comp->nfb->dev, "Can't lock comp %s within %d ms\n", comp->path, timeout);
+	ret = nfb_lock_lock(comp->nfb, &comp->nfb->kernel_app, lock, timeout, false);
+	if (ret == -ETIMEDOUT)
+		dev_warn(comp->nfb->dev, "Can't lock comp %s within %d ms\n", comp->path, timeout);
 
-	return -ETIMEDOUT;
+	return ret;
 }
 
 int nfb_comp_lock(struct nfb_comp *comp, uint32_t features)
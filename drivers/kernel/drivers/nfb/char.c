@@ -63,17 +63,25 @@ static ssize_t nfb_boot_get_load_status(struct device *dev, struct device_attrib
 	return nfb_boot_load_get_status(nfb_boot, buf);
 }
 
+static ssize_t nfb_char_get_lock_stats(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct nfb_device *nfb = dev_get_drvdata(dev);
+	return nfb_lock_get_stats(nfb, buf);
+}
+
 /* Attributes for sysfs - declarations */
 DEVICE_ATTR(serial,   S_IRUGO, nfb_char_get_serial,   NULL);
 DEVICE_ATTR(cardname, S_IRUGO, nfb_char_get_cardname, NULL);
 DEVICE_ATTR(pcislot,  S_IRUGO, nfb_char_get_pcislot,  NULL);
 DEVICE_ATTR(boot_load_status, S_IRUGO, nfb_boot_get_load_status,   NULL);
+DEVICE_ATTR(lock_stats, S_IRUGO, nfb_char_get_lock_stats, NULL);
 
 struct attribute *nfb_char_attrs[] = {
 	&dev_attr_serial.attr,
 	&dev_attr_cardname.attr,
 	&dev_attr_pcislot.attr,
 	&dev_attr_boot_load_status.attr,
+	&dev_attr_lock_stats.attr,
 	NULL,
 };
 
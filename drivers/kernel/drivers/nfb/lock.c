@@ -9,7 +9,10 @@
 
 #include <linux/module.h>
 #include <linux/bitmap.h>
+#include <linux/jhash.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 
@@ -17,14 +20,64 @@
 
 #include "nfb.h"
 
+static inline u32 nfb_lock_hash(const char *path)
+{
+	return jhash(path, strlen(path), 0);
+}
+
+/* Find the item of @app for @path; caller holds lock_mutex */
+static struct nfb_lock_item *nfb_lock_find(struct nfb_device *nfb, struct nfb_app *app, const char *path, u32 hash)
+{
+	struct nfb_lock_item *item;
+
+	hash_for_each_possible(nfb->lock_table, item, node, hash) {
+		if (item->hash == hash && item->app == app && strcmp(item->path, path) == 0)
+			return item;
+	}
+	return NULL;
+}
+
+/* Delete item and account its hold time; caller holds lock_mutex */
+static void nfb_lock_item_free(struct nfb_device *nfb, struct nfb_lock_item *item)
+{
+	u64 hold;
+
+	hold = ktime_to_ns(ktime_sub(ktime_get(), item->locked_at));
+	nfb->lock_stats.hold_ns += hold;
+	if (nfb->lock_stats.hold_max_ns < hold)
+		nfb->lock_stats.hold_max_ns = hold;
+
+	hash_del(&item->node);
+	kfree(item);
+}
+
+/* Waiters share the bucket of the lock_table with the component they want */
+static inline struct nfb_lock_waitq *nfb_lock_waitq(struct nfb_device *nfb, u32 hash)
+{
+	return &nfb->lock_wait[hash_min(hash, HASH_BITS(nfb->lock_table))];
+}
+
+/* Wake up waiters of the bucket, some of the features they want can be free now */
+static void nfb_lock_wake(struct nfb_lock_waitq *wq)
+{
+	atomic_inc(&wq->seq);
+	wake_up_all(&wq->wait);
+}
+
 /**
  * nfb_lock_probe - Initialize NFB device lock subsystem
  * @nfb: NFB device
  */
 int nfb_lock_probe(struct nfb_device *nfb)
 {
-	INIT_LIST_HEAD(&nfb->lock_list);
+	int i;
+
+	hash_init(nfb->lock_table);
 	mutex_init(&nfb->lock_mutex);
+	for (i = 0; i < ARRAY_SIZE(nfb->lock_wait); i++) {
+		init_waitqueue_head(&nfb->lock_wait[i].wait);
+		atomic_set(&nfb->lock_wait[i].seq, 0);
+	}
 
 	return 0;
 }
@@ -35,11 +88,13 @@ int nfb_lock_probe(struct nfb_device *nfb)
  */
 int nfb_lock_remove(struct nfb_device *nfb)
 {
-	struct nfb_lock_item *item, *temp;
+	int bkt;
+	struct hlist_node *temp;
+	struct nfb_lock_item *item;
 
 	/* Delete all items */
-	list_for_each_entry_safe(item, temp, &nfb->lock_list, list) {
-		list_del(&item->list);
+	hash_for_each_safe(nfb->lock_table, bkt, temp, item, node) {
+		hash_del(&item->node);
 		kfree(item);
 	}
 	return 0;
@@ -64,18 +119,26 @@ int nfb_lock_open(struct nfb_device *nfb, struct nfb_app *app)
  */
 void nfb_lock_release(struct nfb_device *nfb, struct nfb_app *app)
 {
-	struct nfb_lock_item *item, *temp;
+	int bkt;
+	struct hlist_node *temp;
+	struct nfb_lock_item *item;
+	DECLARE_BITMAP(released, HASH_SIZE(nfb->lock_table));
+
+	bitmap_zero(released, HASH_SIZE(nfb->lock_table));
 
 	mutex_lock(&nfb->lock_mutex);
 
 	/* Delete items of current app */
-	list_for_each_entry_safe(item, temp, &nfb->lock_list, list) {
+	hash_for_each_safe(nfb->lock_table, bkt, temp, item, node) {
 		if (item->app == app) {
-			list_del(&item->list);
-			kfree(item);
+			nfb_lock_item_free(nfb, item);
+			set_bit(bkt, released);
 		}
 	}
 	mutex_unlock(&nfb->lock_mutex);
+
+	for_each_set_bit(bkt, released, HASH_SIZE(nfb->lock_table))
+		nfb_lock_wake(&nfb->lock_wait[bkt]);
 }
 
 /**
@@ -88,17 +151,21 @@ int nfb_lock_try_lock(struct nfb_device *nfb, struct nfb_app *app, struct nfb_lo
 {
 	int ret = 0;
 	int len;
+	u32 hash;
 	struct nfb_lock_item *item, *temp;
 
+	hash = nfb_lock_hash(lock.path);
+
 	mutex_lock(&nfb->lock_mutex);
 
 	temp = NULL;
 
 	/* Check features through all aplications */
-	list_for_each_entry(item, &nfb->lock_list, list) {
-		if (strcmp(item->path, lock.path) == 0) {
+	hash_for_each_possible(nfb->lock_table, item, node, hash) {
+		if (item->hash == hash && strcmp(item->path, lock.path) == 0) {
 			if ((item->features & lock.features) != 0) {
 				/* Some of requested features are already locked */
+				nfb->lock_stats.contended++;
 				mutex_unlock(&nfb->lock_mutex);
 				return -EBUSY;
 			}
@@ -120,21 +187,88 @@ int nfb_lock_try_lock(struct nfb_device *nfb, struct nfb_app *app, struct nfb_lo
 			return -ENOMEM;
 		}
 
-		INIT_LIST_HEAD(&item->list);
 		item->features = 0;
 		item->app = app;
+		item->hash = hash;
+		item->locked_at = ktime_get();
 		item->path = (char *) (item + 1);
 		strncpy(item->path, lock.path, len);
 
-		list_add(&item->list, &nfb->lock_list);
+		hash_add(nfb->lock_table, &item->node, hash);
 	}
 
 	item->features |= lock.features;
+	nfb->lock_stats.locked++;
 
 	mutex_unlock(&nfb->lock_mutex);
 	return ret;
 }
 
+/**
+ * nfb_lock_lock - Lock a specific component, wait until the features are free
+ * @nfb: NFB device
+ * @app: NFB application
+ * @lock: Lock information (component + features)
+ * @timeout: Maximum time to wait in ms; zero doesn't wait, negative waits without limit
+ * @intr: The wait can be interrupted by a signal
+ *
+ * Return: 0 on success, -EBUSY if not locked with zero @timeout, -ETIMEDOUT
+ * if not locked in @timeout, -ERESTARTSYS on signal or other negative error code.
+ */
+int nfb_lock_lock(struct nfb_device *nfb, struct nfb_app *app, struct nfb_lock lock, int timeout, bool intr)
+{
+	int ret;
+	int seq;
+	long remaining;
+	bool waited = false;
+	ktime_t start;
+	u64 wait;
+	struct nfb_lock_waitq *wq;
+
+	remaining = timeout < 0 ? MAX_SCHEDULE_TIMEOUT : msecs_to_jiffies(timeout);
+	start = ktime_get();
+	wq = nfb_lock_waitq(nfb, nfb_lock_hash(lock.path));
+
+	for (;;) {
+		/* Read the sequence before the attempt, an unlock in between wakes us up */
+		seq = atomic_read(&wq->seq);
+		ret = nfb_lock_try_lock(nfb, app, lock);
+		if (ret != -EBUSY || remaining == 0)
+			break;
+
+		waited = true;
+		if (intr) {
+			remaining = wait_event_interruptible_timeout(wq->wait,
+					atomic_read(&wq->seq) != seq, remaining);
+		} else {
+			remaining = wait_event_timeout(wq->wait,
+					atomic_read(&wq->seq) != seq, remaining);
+		}
+
+		if (remaining < 0) {
+			ret = remaining;
+			break;
+		}
+	}
+
+	if (waited) {
+		wait = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		mutex_lock(&nfb->lock_mutex);
+		nfb->lock_stats.waits++;
+		nfb->lock_stats.wait_ns += wait;
+		if (nfb->lock_stats.wait_max_ns < wait)
+			nfb->lock_stats.wait_max_ns = wait;
+		if (ret == -EBUSY)
+			nfb->lock_stats.timeouts++;
+		mutex_unlock(&nfb->lock_mutex);
+	}
+
+	if (ret == -EBUSY && timeout != 0)
+		ret = -ETIMEDOUT;
+
+	return ret;
+}
 
 /**
  * nfb_lock_unlock - Unlock specific features of specific component
@@ -148,21 +282,14 @@ int nfb_lock_try_lock(struct nfb_device *nfb, struct nfb_app *app, struct nfb_lo
 int nfb_lock_unlock(struct nfb_device *nfb, struct nfb_app *app, struct nfb_lock lock)
 {
 	int ret = 0;
-	struct nfb_lock_item *item, *temp;
+	u32 hash;
+	struct nfb_lock_item *item;
 
-	temp = NULL;
+	hash = nfb_lock_hash(lock.path);
 
 	mutex_lock(&nfb->lock_mutex);
 
-	list_for_each_entry(item, &nfb->lock_list, list) {
-		if (item->app == app && strcmp(item->path, lock.path) == 0) {
-			temp = item;
-			break;
-		}
-	}
-
-	item = temp;
-
+	item = nfb_lock_find(nfb, app, lock.path, hash);
 	if (item == NULL) {
 		mutex_unlock(&nfb->lock_mutex);
 		return -ENODEV;
@@ -171,14 +298,50 @@ int nfb_lock_unlock(struct nfb_device *nfb, struct nfb_app *app, struct nfb_lock
 	item->features &= ~lock.features;
 
 	if (item->features == 0) {
-		list_del(&item->list);
-		kfree(item);
+		nfb_lock_item_free(nfb, item);
 	}
 
 	mutex_unlock(&nfb->lock_mutex);
+
+	nfb_lock_wake(nfb_lock_waitq(nfb, hash));
 	return ret;
 }
 
+/**
+ * nfb_lock_get_stats - Print lock statistics and currently locked components
+ * @nfb: NFB device
+ * @buf: sysfs buffer
+ */
+ssize_t nfb_lock_get_stats(struct nfb_device *nfb, char *buf)
+{
+	int bkt;
+	ssize_t len;
+	ktime_t now;
+	struct nfb_lock_item *item;
+	struct nfb_lock_stats *s = &nfb->lock_stats;
+
+	mutex_lock(&nfb->lock_mutex);
+
+	len = scnprintf(buf, PAGE_SIZE,
+			"locked %lu\ncontended %lu\nwaits %lu\ntimeouts %lu\n"
+			"wait_us %llu\nwait_max_us %llu\nhold_us %llu\nhold_max_us %llu\n",
+			s->locked, s->contended, s->waits, s->timeouts,
+			div_u64(s->wait_ns, NSEC_PER_USEC), div_u64(s->wait_max_ns, NSEC_PER_USEC),
+			div_u64(s->hold_ns, NSEC_PER_USEC), div_u64(s->hold_max_ns, NSEC_PER_USEC));
+
+	/* Components locked right now: path, features, holder and hold time in us */
+	now = ktime_get();
+	hash_for_each(nfb->lock_table, bkt, item, node) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%s 0x%x %s %lld\n",
+				item->path, item->features,
+				item->app == &nfb->kernel_app ? "kernel" : "user",
+				ktime_us_delta(now, item->locked_at));
+	}
+
+	mutex_unlock(&nfb->lock_mutex);
+	return len;
+}
+
 /**
  * nfb_lock_ioctl - NFB lock subsystem IOCTL handler
  * @nfb: NFB device
@@ -190,6 +353,7 @@ long nfb_lock_ioctl(struct nfb_device *nfb, struct nfb_app *app, unsigned int cm
 {
 	void __user *argp = (void __user *)arg;
 	struct nfb_lock lock;
+	struct nfb_lock_wait lock_wait;
 	char path[MAX_FDT_PATH_LENGTH + 1];
 	int ret;
 
@@ -198,17 +362,27 @@ long nfb_lock_ioctl(struct nfb_device *nfb, struct nfb_app *app, unsigned int cm
 	if (cmd == NFB_LOCK_IOC_TRY_LOCK || cmd == NFB_LOCK_IOC_UNLOCK) {
 		if (copy_from_user(&lock, argp, sizeof(lock)))
 			return -EFAULT;
-		ret = strncpy_from_user(path, lock.path, MAX_FDT_PATH_LENGTH);
-		if (ret == MAX_FDT_PATH_LENGTH || ret <= 0)
-			return -EINVAL;
-		lock.path = path;
+	} else if (cmd == NFB_LOCK_IOC_LOCK) {
+		if (copy_from_user(&lock_wait, argp, sizeof(lock_wait)))
+			return -EFAULT;
+		lock.path = lock_wait.path;
+		lock.features = lock_wait.features;
+	} else {
+		return -ENOTTY;
 	}
 
+	ret = strncpy_from_user(path, lock.path, MAX_FDT_PATH_LENGTH);
+	if (ret == MAX_FDT_PATH_LENGTH || ret <= 0)
+		return -EINVAL;
+	lock.path = path;
+
 	switch (cmd) {
 	case NFB_LOCK_IOC_TRY_LOCK:
 		return nfb_lock_try_lock(nfb, app, lock);
 	case NFB_LOCK_IOC_UNLOCK:
 		return nfb_lock_unlock(nfb, app, lock);
+	case NFB_LOCK_IOC_LOCK:
+		return nfb_lock_lock(nfb, app, lock, lock_wait.timeout, true);
 	default:
 		return -ENOTTY;
 	}
@@ -40,13 +40,77 @@ ssize_t ndp_channel_set_discard(struct device *dev,
 	return size;
 }
 
+ssize_t ndp_channel_get_poll_thresh(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct ndp_channel *channel = dev_get_drvdata(dev);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", channel->poll_thresh);
+}
+
+ssize_t ndp_channel_set_poll_thresh(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	char *end;
+	unsigned long val = simple_strtoul(buf, &end, 0);
+	struct ndp_channel *channel = dev_get_drvdata(dev);
+
+	if (end == buf)
+		return -EINVAL;
+
+	WRITE_ONCE(channel->poll_thresh, val);
+	return size;
+}
+
+ssize_t ndp_channel_get_tx_quantum(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct ndp_channel *channel = dev_get_drvdata(dev);
+	return scnprintf(buf, PAGE_SIZE, "%llu\n", channel->tx_quantum);
+}
+
+ssize_t ndp_channel_set_tx_quantum(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	char *end;
+	unsigned long val = simple_strtoul(buf, &end, 0);
+	struct ndp_channel *channel = dev_get_drvdata(dev);
+
+	if (end == buf)
+		return -EINVAL;
+
+	WRITE_ONCE(channel->tx_quantum, val);
+	return size;
+}
+
+ssize_t ndp_channel_get_subscriptions(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct ndp_channel *channel = dev_get_drvdata(dev);
+	struct ndp_subscription *sub;
+	ssize_t len = 0;
+
+	spin_lock_bh(&channel->lock);
+	list_for_each_entry(sub, &channel->list_subscriptions, list_item) {
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				"%s pid %d (%s): lag %lu lag_max %lu syncs %llu stalls %llu%s\n",
+				dev_name(&channel->dev), sub->subscriber->pid, sub->subscriber->comm,
+				sub->stats.lag, sub->stats.lag_max,
+				sub->stats.syncs, sub->stats.stalls,
+				sub == channel->rx_slowest ? " slowest" : "");
+	}
+	spin_unlock_bh(&channel->lock);
+
+	return len;
+}
+
 void ndp_channel_init(struct ndp_channel *channel, struct ndp_channel_id id)
 {
 	channel->id = id;
 	channel->flags = 0;
+	channel->poll_thresh = 0;
 	channel->subscriptions_count = 0;
 	channel->start_count = 0;
 	channel->locked_sub = NULL;
+	channel->rx_slowest = NULL;
+	channel->tx_waiting = 0;
+	channel->tx_quantum = 0;
 
 	spin_lock_init(&channel->lock);
 	mutex_init(&channel->mutex);
@@ -145,6 +209,22 @@ void ndp_channel_unsubscribe(struct ndp_subscription *sub)
 	mutex_unlock(&channel->mutex);
 }
 
+/* Find the farthest swptr; must be called with channel->lock held */
+static void ndp_channel_rx_update_slowest(struct ndp_channel *channel)
+{
+	struct ndp_subscription *list_sub, *slowest = NULL;
+	size_t sub_lock, max_lock = 0;
+
+	list_for_each_entry(list_sub, &channel->list_subscriptions, list_item) {
+		sub_lock = (channel->hwptr - list_sub->swptr) & channel->ptrmask;
+		if (slowest == NULL || sub_lock > max_lock) {
+			max_lock = sub_lock;
+			slowest = list_sub;
+		}
+	}
+	channel->rx_slowest = slowest;
+}
+
 int ndp_channel_start(struct ndp_subscription *sub)
 {
 	int ret;
@@ -161,10 +241,18 @@ int ndp_channel_start(struct ndp_subscription *sub)
 		channel->swptr = channel->hwptr;
 	}
 
-	spin_lock(&channel->lock);
+	spin_lock_bh(&channel->lock);
 	sub->swptr = sub->hwptr = channel->hwptr;
+	memset(&sub->stats, 0, sizeof(sub->stats));
+	/* New subscription starts at hwptr: it can't be slower than the others */
+	if (channel->rx_slowest == NULL)
+		channel->rx_slowest = sub;
+	if (sub->sync_page) {
+		WRITE_ONCE(sub->sync_page->swptr, sub->swptr);
+		WRITE_ONCE(sub->sync_page->hwptr, sub->hwptr);
+	}
 	list_add_tail(&sub->list_item, &channel->list_subscriptions);
-	spin_unlock(&channel->lock);
+	spin_unlock_bh(&channel->lock);
 
 	mutex_unlock(&channel->mutex);
 	return 0;
@@ -196,40 +284,41 @@ int ndp_channel_stop(struct ndp_subscription *sub, int force)
 		}
 	}
 
-	spin_lock(&channel->lock);
+	spin_lock_bh(&channel->lock);
 	list_del_init(&sub->list_item);
-	spin_unlock(&channel->lock);
+	if (channel->rx_slowest == sub)
+		ndp_channel_rx_update_slowest(channel);
+	if (sub->tx_waiting) {
+		sub->tx_waiting = 0;
+		channel->tx_waiting--;
+	}
+	spin_unlock_bh(&channel->lock);
 
 err_again:
 	mutex_unlock(&channel->mutex);
 	return ret;
 }
 
-inline void ndp_channel_rxsync(struct ndp_subscription *sub, struct ndp_subscription_sync *sync)
+static inline void ndp_channel_rxsync_locked(struct ndp_subscription *sub)
 {
-	struct ndp_subscription *list_sub;
-	unsigned long swptr, sub_swptr;
-	size_t sub_lock, max_lock;
 	struct ndp_channel *channel = sub->channel;
-
-	sub->swptr = sync->swptr;
-
-	spin_lock(&channel->lock);
-	rmb();
-
-	max_lock = 0;
-	swptr = sub->swptr;
-
-	/* Find the farthest swptr */
-	list_for_each_entry(list_sub, &channel->list_subscriptions, list_item) {
-		sub_swptr = list_sub->swptr;
-		sub_lock = (channel->hwptr - sub_swptr) & channel->ptrmask;
-		if (sub_lock > max_lock) {
-			max_lock = sub_lock;
-			swptr = sub_swptr;
-		}
+	struct ndp_subscription *slowest = channel->rx_slowest;
+	unsigned long swptr;
+	size_t lag;
+
+	lag = (channel->hwptr - sub->swptr) & channel->ptrmask;
+
+	/* Only the slowest subscription moves the channel swptr: when it advances,
+	 * find the new one. Any other subscription is just compared with it. */
+	if (!list_empty(&sub->list_item)) {
+		if (slowest == sub)
+			ndp_channel_rx_update_slowest(channel);
+		else if (slowest == NULL || lag > ((channel->hwptr - slowest->swptr) & channel->ptrmask))
+			channel->rx_slowest = sub;
 	}
 
+	swptr = channel->rx_slowest ? channel->rx_slowest->swptr : sub->swptr;
+
 	/* Update swptr only when changed */
 	if (swptr != channel->swptr) {
 		channel->swptr = swptr;
@@ -240,25 +329,117 @@ inline void ndp_channel_rxsync(struct ndp_subscription *sub, struct ndp_subscrip
 	channel->hwptr = channel->ops->get_hwptr(channel);
 	sub->hwptr = channel->hwptr;
 
+	lag = (sub->hwptr - sub->swptr) & channel->ptrmask;
+	sub->stats.lag = lag;
+	if (lag > sub->stats.lag_max)
+		sub->stats.lag_max = lag;
+	if (channel->rx_slowest == sub && lag > channel->ptrmask - (channel->ptrmask >> 2))
+		sub->stats.stalls++;
+	sub->stats.syncs++;
+
+	/* The shared page must never publish an older hwptr than the ioctl did */
+	if (sub->sync_page)
+		WRITE_ONCE(sub->sync_page->hwptr, sub->hwptr);
+}
+
+inline void ndp_channel_rxsync(struct ndp_subscription *sub, struct ndp_subscription_sync *sync)
+{
+	struct ndp_channel *channel = sub->channel;
+
+	sub->swptr = sync->swptr;
+
+	spin_lock_bh(&channel->lock);
+	rmb();
+
+	ndp_channel_rxsync_locked(sub);
+
 	wmb();
-	spin_unlock(&channel->lock);
+	spin_unlock_bh(&channel->lock);
 
 	sync->hwptr = sub->hwptr;
 }
 
+/**
+ * ndp_channel_rxsync_page - synchronize pointers through the mmapped sync page
+ * @sub: RX subscription with allocated sync page
+ *
+ * Takes the swptr published by the application and publishes the current hwptr.
+ * Subscriptions, which are not started, are skipped.
+ */
+void ndp_channel_rxsync_page(struct ndp_subscription *sub)
+{
+	struct ndp_channel *channel = sub->channel;
+
+	spin_lock_bh(&channel->lock);
+	if (!list_empty(&sub->list_item)) {
+		rmb();
+		sub->swptr = READ_ONCE(sub->sync_page->swptr);
+		ndp_channel_rxsync_locked(sub);
+		wmb();
+	}
+	spin_unlock_bh(&channel->lock);
+}
+
+/**
+ * ndp_channel_rx_available - amount of data not yet synced by the subscription
+ * @sub: RX subscription
+ *
+ * Refreshes the channel hwptr the same way as the rxsync does. The result is
+ * in the pointer units of the channel: bytes for v1, headers for v2 and v3.
+ * Must not be called from the hardirq context.
+ */
+uint64_t ndp_channel_rx_available(struct ndp_subscription *sub)
+{
+	uint64_t avail = 0;
+	struct ndp_channel *channel = sub->channel;
+
+	spin_lock_bh(&channel->lock);
+	if (!list_empty(&sub->list_item)) {
+		rmb();
+		channel->hwptr = channel->ops->get_hwptr(channel);
+		avail = (channel->hwptr - sub->swptr) & channel->ptrmask;
+	}
+	spin_unlock_bh(&channel->lock);
+
+	return avail;
+}
+
+static inline void ndp_channel_tx_set_waiting(struct ndp_subscription *sub, int waiting)
+{
+	if (sub->tx_waiting != waiting) {
+		sub->tx_waiting = waiting;
+		if (waiting)
+			sub->channel->tx_waiting++;
+		else
+			sub->channel->tx_waiting--;
+	}
+}
+
+/*
+ * The TX ring is consumed by the controller strictly in order, so only one
+ * subscriber can hold a lock of the free space at the time. Fairness:
+ * while other subscribers wait, the holder can't grow the lock over
+ * tx_quantum since it got the lock and it can't take the lock again before
+ * some of the waiting subscribers.
+ */
 inline void ndp_channel_txsync(struct ndp_subscription *sub, struct ndp_subscription_sync *sync)
 {
-	size_t len, chlen;
+	size_t len, chlen, held, used, quantum;
 
 	struct ndp_channel *channel = sub->channel;
 
 	sub->swptr = sync->swptr;
 	sub->hwptr = sync->hwptr;
 
-	spin_lock(&channel->lock);
+	spin_lock_bh(&channel->lock);
 
 	rmb();
 
+	/* Subscriber tries to lock LENGTH bytes */
+	len = (sub->swptr - sub->hwptr) & channel->ptrmask;
+	if (len == 0)
+		ndp_channel_tx_set_waiting(sub, 0);
+
 	if (channel->locked_sub == sub) {
 		/* This subscriber have lock */
 
@@ -272,40 +453,49 @@ inline void ndp_channel_txsync(struct ndp_subscription *sub, struct ndp_subscrip
 		if (channel->ops->get_free_space != NULL)
 			sync->size = channel->ops->get_free_space(channel);
 		chlen = (channel->hwptr - channel->swptr - 1) & channel->ptrmask;
-
-		/* Subscriber tries to lock LENGTH bytes */
-		len = (sub->swptr - sub->hwptr) & channel->ptrmask;
 		len = min(len, chlen);
+
+		if (channel->tx_waiting) {
+			/* Keep the already locked area, it can hold unpublished data */
+			quantum = channel->tx_quantum ? channel->tx_quantum : (channel->ptrmask + 1) / 4;
+			held = (sub->tx_lock_end - channel->swptr) & channel->ptrmask;
+			used = (channel->swptr - channel->tx_lock_start) & channel->ptrmask;
+			len = min(len, max(held, used < quantum ? quantum - used : 0));
+		}
+
 		if (!len) {
 			channel->locked_sub = NULL;
 		}
 
 		sub->hwptr = channel->swptr;
 		sub->swptr = (channel->swptr + len) & channel->ptrmask;
-	} else if (channel->locked_sub == NULL) {
-		/* There is no locked subscriber */
+	} else if (channel->locked_sub == NULL && (sub->tx_waiting || channel->tx_waiting == 0 || len == 0)) {
+		/* There is no locked subscriber and no one else has precedence */
 
 		channel->hwptr = channel->ops->get_hwptr(channel);
 		if (channel->ops->get_free_space != NULL)
 			sync->size = channel->ops->get_free_space(channel);
 		chlen = (channel->hwptr - channel->swptr - 1) & channel->ptrmask;
-
-		/* Subscriber tries to lock LENGTH bytes */
-		len = (sub->swptr - sub->hwptr) & channel->ptrmask;
 		len = min(len, chlen);
 		if (len) {
 			channel->locked_sub = sub;
+			channel->tx_lock_start = channel->swptr;
+			ndp_channel_tx_set_waiting(sub, 0);
 		}
 
 		sub->hwptr = channel->swptr;
 		sub->swptr = (channel->swptr + len) & channel->ptrmask;
 	} else {
-		/* Other subscribers have lock */
+		/* Other subscribers have lock or precedence */
+		if (len && !list_empty(&sub->list_item))
+			ndp_channel_tx_set_waiting(sub, 1);
 		sub->hwptr = channel->swptr;
 		sub->swptr = channel->swptr;
 	}
 
-	spin_unlock(&channel->lock);
+	sub->tx_lock_end = sub->swptr;
+
+	spin_unlock_bh(&channel->lock);
 	sync->hwptr = sub->hwptr;
 	sync->swptr = sub->swptr;
 }
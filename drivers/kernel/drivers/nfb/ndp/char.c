@@ -131,6 +131,34 @@ long ndp_char_ioctl(void *priv, void *app_priv, struct file *file, unsigned int
 		ret = ndp_subscription_stop(sub, 0);
 		break;
 	}
+	case NDP_IOC_POLL: {
+		struct ndp_subscriber_poll poll;
+		if (copy_from_user(&poll, argp, sizeof(poll)))
+			return -EFAULT;
+
+		ndp_subscriber_set_poll(subscriber, &poll);
+
+		if (copy_to_user(argp, &poll, sizeof(poll)))
+			return -EFAULT;
+		break;
+	}
+	case NDP_IOC_SYNC_PAGE: {
+		struct ndp_subscription_mmap req;
+		if (copy_from_user(&req, argp, sizeof(req)))
+			return -EFAULT;
+
+		sub = ndp_subscription_by_id(subscriber, req.id);
+		if (sub == NULL)
+			return -EBADF;
+
+		ret = ndp_subscription_map_sync_page(sub, &req);
+		if (ret)
+			return ret;
+
+		if (copy_to_user(argp, &req, sizeof(req)))
+			return -EFAULT;
+		break;
+	}
 	default:
 		return -ENXIO;
 	}
@@ -53,15 +53,21 @@ unsigned ndp_ctrl_tx_request_size = 512;
 /* Attributes for sysfs - declarations */
 static DEVICE_ATTR(ring_size,   (S_IRUGO | S_IWGRP | S_IWUSR), ndp_channel_get_ring_size, ndp_channel_set_ring_size);
 static DEVICE_ATTR(discard,     (S_IRUGO | S_IWGRP | S_IWUSR), ndp_channel_get_discard, ndp_channel_set_discard);
+static DEVICE_ATTR(poll_thresh, (S_IRUGO | S_IWGRP | S_IWUSR), ndp_channel_get_poll_thresh, ndp_channel_set_poll_thresh);
+static DEVICE_ATTR(subscriptions, S_IRUGO, ndp_channel_get_subscriptions, NULL);
+static DEVICE_ATTR(tx_quantum,  (S_IRUGO | S_IWGRP | S_IWUSR), ndp_channel_get_tx_quantum, ndp_channel_set_tx_quantum);
 
 static struct attribute *ndp_ctrl_rx_attrs[] = {
 	&dev_attr_ring_size.attr,
 	&dev_attr_discard.attr,
+	&dev_attr_poll_thresh.attr,
+	&dev_attr_subscriptions.attr,
 	NULL,
 };
 
 static struct attribute *ndp_ctrl_tx_attrs[] = {
 	&dev_attr_ring_size.attr,
+	&dev_attr_tx_quantum.attr,
 	NULL,
 };
 
@@ -12,6 +12,7 @@
 #include <linux/fs.h>
 #include <linux/irq.h>
 #include <linux/kernel.h>
+#include <linux/log2.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/pci.h>
@@ -35,6 +36,10 @@
 #define NDP_CTRL_MODE_STREAM         1 /* More packets in one descriptor with 8B padding */
 #define NDP_CTRL_MODE_USER           2 /* User provides descriptors in offset + header buffer */
 
+#define NDP_CTRL_STREAM_ALIGN 8
+/* Shortest frame in stream mode (Ethernet without FCS), sizes the header ring */
+#define NDP_CTRL_STREAM_FRAME_MIN 60
+
 #define NDP_CTRL_NEXT_SDP_AGE_MAX 16
 
 #define virt_to_phys_shift(x) (virt_to_phys(x) >> PAGE_SHIFT)
@@ -58,6 +63,7 @@ struct ndp_ctrl_cfg {
 	uint32_t block_count;
 	uint32_t block_size;
 	uint32_t initial_offset;
+	uint32_t mode;
 };
 
 /* buffer/ring pointers for walkthrough in packet-simple mode */
@@ -81,6 +87,11 @@ struct ndp_ctrl {
 	struct nc_ndp_desc *desc_buffer_v;
 	ndp_offset_t    *off_buffer_v;
 
+	/* Prepared RX descriptors for one walk through the ring */
+	struct nc_ndp_desc *desc_table;
+	uint32_t desc_table_len;
+	uint32_t desc_table_pos;
+
 	union {
 		struct {
 			void *hdr_buffer_v;
@@ -186,7 +197,7 @@ static inline int ndp_ctrl_medusa_mps_inc(struct ndp_ctrl_state_mps *s)
 /* Check buffer configuration and compute block_count for ring allocation.
  * Optionally resize the ring with new configuration.
  */
-static int ndp_ctrl_medusa_req_block_update(struct ndp_ctrl *ctrl, int do_resize, size_t buffer_size, size_t buffer_count, size_t initial_offset)
+static int ndp_ctrl_medusa_req_block_update(struct ndp_ctrl *ctrl, int do_resize, size_t buffer_size, size_t buffer_count, size_t initial_offset, uint32_t mode)
 {
 	int ret = 0;
 	/* optimization - enable shadowed mmap, which needs at least PAGE_SIZE space */
@@ -197,6 +208,16 @@ static int ndp_ctrl_medusa_req_block_update(struct ndp_ctrl *ctrl, int do_resize
 	if (buffer_size == 0 || buffer_count < min_buffer_items)
 		return -EINVAL;
 
+	if (mode == NDP_CTRL_MODE_STREAM) {
+		/* Descriptors must tile the ring without gaps: data continues
+		 * in the next descriptor and wraps together with the ring */
+		if (!ispow2(buffer_size) || buffer_size > ctrl->channel.req_block_size)
+			return -EINVAL;
+		initial_offset = 0;
+	} else if (mode != NDP_CTRL_MODE_PACKET_SIMPLE) {
+		return -EINVAL;
+	}
+
 	/* walk through (virtual) ring to obtain parameters
 	 * - the inc with buffer_count = 0 never wraps/resets buffer_index
 	 * - the inc with block_count = 0 never wraps/resets block_index
@@ -212,6 +233,17 @@ static int ndp_ctrl_medusa_req_block_update(struct ndp_ctrl *ctrl, int do_resize
 
 	s.cfg.block_count = s.block_index + 1;
 	s.cfg.buffer_count = s.buffer_index;
+	s.cfg.mode = mode;
+
+	/* The stream wraps at the ring end, so the descriptors must cover
+	 * the whole last block: the requested buffer_count is rounded up
+	 * (the buffer_count attribute shows the value in use). The rounded
+	 * count is the descriptor ring size and must stay a power of two. */
+	if (mode == NDP_CTRL_MODE_STREAM) {
+		s.cfg.buffer_count = s.cfg.block_count * (s.cfg.block_size / buffer_size);
+		if (!ispow2(s.cfg.buffer_count))
+			return -EINVAL;
+	}
 
 	ctrl->cfg = s.cfg;
 	ctrl->channel.req_block_count = s.cfg.block_count;
@@ -244,7 +276,7 @@ static ssize_t ndp_ctrl_set_buffer_size(struct device *dev,
 
 	value = memparse(buf, NULL);
 
-	ret = ndp_ctrl_medusa_req_block_update(ctrl, 1, value, ctrl->cfg.buffer_count, ctrl->cfg.initial_offset);
+	ret = ndp_ctrl_medusa_req_block_update(ctrl, 1, value, ctrl->cfg.buffer_count, ctrl->cfg.initial_offset, ctrl->cfg.mode);
 	if (ret)
 		return ret;
 
@@ -269,7 +301,7 @@ static ssize_t ndp_ctrl_set_buffer_count(struct device *dev,
 
 	value = memparse(buf, NULL);
 
-	ret = ndp_ctrl_medusa_req_block_update(ctrl, 1, ctrl->cfg.buffer_size, value, ctrl->cfg.initial_offset);
+	ret = ndp_ctrl_medusa_req_block_update(ctrl, 1, ctrl->cfg.buffer_size, value, ctrl->cfg.initial_offset, ctrl->cfg.mode);
 	if (ret)
 		return ret;
 
@@ -294,7 +326,42 @@ static ssize_t ndp_ctrl_set_initial_offset(struct device *dev,
 
 	value = memparse(buf, NULL);
 
-	ret = ndp_ctrl_medusa_req_block_update(ctrl, 1, ctrl->cfg.buffer_size, ctrl->cfg.buffer_count, value);
+	ret = ndp_ctrl_medusa_req_block_update(ctrl, 1, ctrl->cfg.buffer_size, ctrl->cfg.buffer_count, value, ctrl->cfg.mode);
+	if (ret)
+		return ret;
+
+	return size;
+}
+
+static const char *const ndp_ctrl_mode_names[] = {
+	[NDP_CTRL_MODE_PACKET_SIMPLE] = "packet",
+	[NDP_CTRL_MODE_STREAM] = "stream",
+};
+
+static ssize_t ndp_ctrl_get_mode(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct ndp_channel *channel = dev_get_drvdata(dev);
+	struct ndp_ctrl *ctrl = container_of(channel, struct ndp_ctrl, channel);
+
+	return scnprintf(buf, PAGE_SIZE, "%s\n", ndp_ctrl_mode_names[ctrl->cfg.mode]);
+}
+
+static ssize_t ndp_ctrl_set_mode(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	int ret;
+	uint32_t mode;
+	struct ndp_channel *channel = dev_get_drvdata(dev);
+	struct ndp_ctrl *ctrl = container_of(channel, struct ndp_ctrl, channel);
+
+	for (mode = 0; mode < ARRAY_SIZE(ndp_ctrl_mode_names); mode++) {
+		if (sysfs_streq(buf, ndp_ctrl_mode_names[mode]))
+			break;
+	}
+	if (mode == ARRAY_SIZE(ndp_ctrl_mode_names))
+		return -EINVAL;
+
+	ret = ndp_ctrl_medusa_req_block_update(ctrl, 1, ctrl->cfg.buffer_size, ctrl->cfg.buffer_count, ctrl->cfg.initial_offset, mode);
 	if (ret)
 		return ret;
 
@@ -347,7 +414,7 @@ static ssize_t ndp_ctrl_set_ring_size(struct device *dev,
 	while (buffer_count * 2 <= value / ctrl->cfg.buffer_size)
 		buffer_count *= 2;
 
-	ret = ndp_ctrl_medusa_req_block_update(ctrl, 1, ctrl->cfg.buffer_size, buffer_count, ctrl->cfg.initial_offset);
+	ret = ndp_ctrl_medusa_req_block_update(ctrl, 1, ctrl->cfg.buffer_size, buffer_count, ctrl->cfg.initial_offset, ctrl->cfg.mode);
 	if (ret)
 		return ret;
 
@@ -377,31 +444,89 @@ int ndp_ctrl_v3_get_vmaps(struct ndp_channel *channel, void **hdr, size_t * hdr_
 	return ctrl->hdr_count;
 }
 
-static void ndp_ctrl_mps_fill_rx_descs(struct ndp_ctrl *ctrl, uint64_t count)
+/* Walk through the ring as the controller does and optionally store the descriptors.
+ * returns count of descriptors for one walk
+ */
+static uint32_t ndp_ctrl_mps_walk_rx_descs(struct ndp_ctrl *ctrl, struct nc_ndp_desc *desc)
 {
-	int i;
-	uint32_t sdp = ctrl->c.sdp;
-	struct nc_ndp_desc *desc = ctrl->desc_buffer_v + sdp;
-	uint64_t last_upper_addr = ctrl->c.last_upper_addr;
+	uint32_t count = 0;
+	uint64_t last_upper_addr;
+	struct ndp_ctrl_state_mps s;
 
-	/* TODO: Table of prepared descriptor bursts with all meta (desc. count etc) */
-	for (i = 0; i < count; i++) {
+	s.cfg = ctrl->mps.cfg;
+	ndp_ctrl_medusa_mps_meta_first(&s);
+
+	/* Always start with the upper address: the walk is repeated after each ring wrap */
+	last_upper_addr = 0xFFFFFFFFFFFFFFFFull;
+	do {
 		dma_addr_t addr;
 
-		addr = ctrl->channel.ring.blocks[ctrl->mps.block_index].phys;
-		addr += ctrl->mps.block_offset;
+		addr = ctrl->channel.ring.blocks[s.block_index].phys;
+		addr += s.block_offset;
 
 		if (unlikely(NDP_CTRL_DESC_UPPER_ADDR(addr) != last_upper_addr)) {
 			last_upper_addr = NDP_CTRL_DESC_UPPER_ADDR(addr);
-			ctrl->c.last_upper_addr = last_upper_addr;
-			desc[i] = nc_ndp_rx_desc0(addr);
-			continue;
+			if (desc)
+				desc[count] = nc_ndp_rx_desc0(addr);
+			count++;
 		}
-		desc[i] = nc_ndp_rx_desc2(addr, ctrl->mps.cfg.buffer_size, 0);
+		if (desc)
+			desc[count] = nc_ndp_rx_desc2(addr, s.cfg.buffer_size, 0);
+		count++;
+	} while (ndp_ctrl_medusa_mps_inc(&s) != -1);
+
+	return count;
+}
+
+static int ndp_ctrl_mps_alloc_rx_desc_table(struct ndp_ctrl *ctrl)
+{
+	uint32_t count;
+
+	count = ndp_ctrl_mps_walk_rx_descs(ctrl, NULL);
+	ctrl->desc_table = vmalloc_node(count * sizeof(*ctrl->desc_table), dev_to_node(ctrl->channel.ring.dev));
+	if (ctrl->desc_table == NULL)
+		return -ENOMEM;
+
+	ndp_ctrl_mps_walk_rx_descs(ctrl, ctrl->desc_table);
+	ctrl->desc_table_len = count;
+	ctrl->desc_table_pos = 0;
+	return 0;
+}
+
+static void ndp_ctrl_mps_fill_rx_descs(struct ndp_ctrl *ctrl, uint64_t count)
+{
+	uint32_t n;
+	uint32_t sdp = ctrl->c.sdp;
+	struct nc_ndp_desc *desc = ctrl->desc_buffer_v + sdp;
 
-		ndp_ctrl_medusa_mps_inc(&ctrl->mps);
-	}
 	ctrl->c.sdp = (sdp + count) & ctrl->c.mdp;
+
+	/* The descriptor ring is shadowed: copy the prepared table in one or two chunks */
+	while (count) {
+		n = min_t(uint64_t, count, ctrl->desc_table_len - ctrl->desc_table_pos);
+		memcpy(desc, ctrl->desc_table + ctrl->desc_table_pos, n * sizeof(*desc));
+		desc += n;
+		count -= n;
+
+		ctrl->desc_table_pos += n;
+		if (ctrl->desc_table_pos == ctrl->desc_table_len)
+			ctrl->desc_table_pos = 0;
+	}
+}
+
+/* Give the released descriptors back to the controller in whole bursts */
+static void ndp_ctrl_mps_refill_rx_descs(struct ndp_ctrl *ctrl)
+{
+	int filled = 0;
+
+	while (ctrl->free_desc >= NDP_CTRL_RX_DESC_BURST) {
+		ndp_ctrl_mps_fill_rx_descs(ctrl, NDP_CTRL_RX_DESC_BURST);
+		ctrl->free_desc -= NDP_CTRL_RX_DESC_BURST;
+		filled = 1;
+	}
+	if (filled) {
+		nc_ndp_ctrl_sp_flush(&ctrl->c);
+	}
 }
 
 static void ndp_ctrl_user_fill_rx_descs(struct ndp_ctrl *ctrl)
@@ -506,17 +631,20 @@ static void ndp_ctrl_medusa_rx_set_swptr(struct ndp_channel *channel, uint64_t p
 		ctrl->free_desc += free_desc + free_desc2 * 2;
 		ctrl->c.shp = ptr;
 
-		count = 0;
-		while (ctrl->free_desc >= NDP_CTRL_RX_DESC_BURST) {
-			ndp_ctrl_mps_fill_rx_descs(ctrl, NDP_CTRL_RX_DESC_BURST);
-			ctrl->free_desc -= NDP_CTRL_RX_DESC_BURST;
-			count = 1;
-		}
-		if (count) {
-			nc_ndp_ctrl_sp_flush(&ctrl->c);
-		}
+		ndp_ctrl_mps_refill_rx_descs(ctrl);
 	} else if (ctrl->mode == NDP_CTRL_MODE_STREAM) {
-		/* TODO */
+		int i;
+		int count;
+
+		/* Packets share descriptors: the one which fills up
+		 * a descriptor (or a few of them) releases it */
+		count = (ptr - shp) & ctrl->c.mhp;
+		for (i = 0; i < count; i++) {
+			ctrl->free_desc += hdr[i].free_desc;
+		}
+		ctrl->c.shp = ptr;
+
+		ndp_ctrl_mps_refill_rx_descs(ctrl);
 	} else if (ctrl->mode == NDP_CTRL_MODE_USER) {
 		ctrl->c.shp = ptr;
 		nc_ndp_ctrl_hdp_update(&ctrl->c);
@@ -580,12 +708,17 @@ static uint64_t ndp_ctrl_rx_get_hwptr(struct ndp_channel *channel)
 	if (ctrl->mode == NDP_CTRL_MODE_PACKET_SIMPLE) {
 		/* Constant packet offsets in this mode */
 	} else if (ctrl->mode == NDP_CTRL_MODE_STREAM) {
+		/* Packets follow each other with 8B padding, the ring is mapped twice
+		 * so a packet crossing the ring end stays contiguous for the user */
+		ndp_offset_t next;
 		struct nc_ndp_hdr *hdr = ctrl->ts.medusa.hdr_buffer + hhp;
 		ndp_offset_t *off = ctrl->off_buffer_v + hhp;
 		for (i = 0; i < count; i++) {
-			off[i+1] = off[i] + hdr[i].frame_len;
+			next = off[i] + ALIGN(hdr[i].frame_len, NDP_CTRL_STREAM_ALIGN);
+			if (next >= channel->ring.size)
+				next -= channel->ring.size;
+			off[i+1] = next;
 		}
-		off[i] &= channel->ring.size - 1;
 	} else if (ctrl->mode == NDP_CTRL_MODE_USER) {
 		/* Check if some descs from userspace can be written */
 		if (count && ctrl->php != ctrl->c.shp) {
@@ -823,7 +956,10 @@ static int ndp_ctrl_medusa_start(struct ndp_channel *channel, uint64_t *hwptr)
 
 	ctrl->next_sdp = 0;
 
+	/* The stream mode is meaningful for the receive direction only */
 	ctrl->mode = NDP_CTRL_MODE_PACKET_SIMPLE;
+	if (channel->id.type == NDP_CHANNEL_TYPE_RX)
+		ctrl->mode = ctrl->mps.cfg.mode;
 
 	if (ctrl->mode == NDP_CTRL_MODE_PACKET_SIMPLE) {
 		/* Constant packet offsets in this mode */
@@ -833,6 +969,10 @@ static int ndp_ctrl_medusa_start(struct ndp_channel *channel, uint64_t *hwptr)
 		do {
 			*(off++) = (ctrl->mps.block_index * ctrl->mps.cfg.block_size) + ctrl->mps.block_offset;
 		} while (ndp_ctrl_medusa_mps_inc(&ctrl->mps) != -1);
+	} else if (ctrl->mode == NDP_CTRL_MODE_STREAM) {
+		/* Offsets of next packets are computed from lengths in rx_get_hwptr */
+		ndp_ctrl_medusa_mps_meta_first(&ctrl->mps);
+		ctrl->off_buffer_v[0] = 0;
 	} else if (ctrl->mode == NDP_CTRL_MODE_USER) {
 		if (channel->id.type == NDP_CHANNEL_TYPE_RX) {
 			ctrl->free_desc = ctrl->c.mhp;
@@ -841,7 +981,8 @@ static int ndp_ctrl_medusa_start(struct ndp_channel *channel, uint64_t *hwptr)
 	}
 
 	if (channel->id.type == NDP_CHANNEL_TYPE_RX) {
-		if (ctrl->mode == NDP_CTRL_MODE_PACKET_SIMPLE) {
+		if (ctrl->mode == NDP_CTRL_MODE_PACKET_SIMPLE || ctrl->mode == NDP_CTRL_MODE_STREAM) {
+			ctrl->desc_table_pos = 0;
 			ndp_ctrl_mps_fill_rx_descs(ctrl, ctrl->c.mdp + 1 - NDP_CTRL_RX_DESC_BURST);
 			nc_ndp_ctrl_sdp_flush(&ctrl->c);
 			ctrl->free_desc = 0;
@@ -1028,7 +1169,7 @@ static int ndp_ctrl_medusa_attach_ring(struct ndp_channel *channel)
 		return -EINVAL;
 
 	/* just check already requested ring parameters */
-	if (ndp_ctrl_medusa_req_block_update(ctrl, 0, ctrl->cfg.buffer_size, ctrl->cfg.buffer_count, ctrl->cfg.initial_offset))
+	if (ndp_ctrl_medusa_req_block_update(ctrl, 0, ctrl->cfg.buffer_size, ctrl->cfg.buffer_count, ctrl->cfg.initial_offset, ctrl->cfg.mode))
 		return -EINVAL;
 
 	/* apply configuration */
@@ -1036,15 +1177,31 @@ static int ndp_ctrl_medusa_attach_ring(struct ndp_channel *channel)
 
 	ctrl->desc_count = ctrl->hdr_count = ctrl->mps.cfg.buffer_count;
 
+	/* One descriptor holds more packets in stream mode: size the header
+	 * ring for the ring full of the shortest frames */
+	if (channel->id.type == NDP_CHANNEL_TYPE_RX && ctrl->mps.cfg.mode == NDP_CTRL_MODE_STREAM) {
+		ctrl->hdr_count = max_t(int, ctrl->desc_count, rounddown_pow_of_two(channel->ring.size /
+				ALIGN(NDP_CTRL_STREAM_FRAME_MIN, NDP_CTRL_STREAM_ALIGN)));
+	}
+
 	channel->ptrmask = ctrl->hdr_count - 1;
 
 	/* allocate update buffer */
-	ctrl->update_buffer = dma_alloc_coherent(dev, ALIGN(NDP_CTRL_UPDATE_SIZE, PAGE_SIZE),
+	ctrl->update_buffer_size = ALIGN(NDP_CTRL_UPDATE_SIZE, PAGE_SIZE);
+	ctrl->update_buffer = dma_alloc_coherent(dev, ctrl->update_buffer_size,
 			&ctrl->update_buffer_phys, GFP_KERNEL);
 	if (ctrl->update_buffer == NULL) {
 		goto err_alloc_update;
 	}
 
+	/* The controller writes its pointers there: applications can check them without sync */
+	ret = nfb_char_register_mmap(channel->ndp->nfb, ctrl->update_buffer_size,
+			&ctrl->upd_mmap_offset, ndp_ctrl_upd_mmap, ctrl);
+	if (ret) {
+		goto err_register_mmap_upd;
+	}
+	ret = -ENOMEM;
+
 	/* allocate descriptor area */
 	ctrl->desc_buffer_size = ALIGN(ctrl->desc_count * NDP_CTRL_RX_DESC_SIZE, PAGE_SIZE);
 	ctrl->desc_buffer = dma_alloc_coherent(dev, ctrl->desc_buffer_size,
@@ -1098,6 +1255,13 @@ static int ndp_ctrl_medusa_attach_ring(struct ndp_channel *channel)
 				"/drivers/ndp/tx_queues" : "/drivers/ndp/rx_queues");
 	node_offset = fdt_subnode_offset(fdt, node_offset, dev_name(&channel->dev));
 
+	if (channel->id.type == NDP_CHANNEL_TYPE_RX) {
+		ret = ndp_ctrl_mps_alloc_rx_desc_table(ctrl);
+		if (ret) {
+			goto err_alloc_desc_table;
+		}
+	}
+
 	fdt_setprop_u32(fdt, node_offset, "protocol", 2);
 	fdt_setprop_u64(fdt, node_offset, "hdr_mmap_base", ctrl->hdr_mmap_offset);
 	fdt_setprop_u64(fdt, node_offset, "hdr_mmap_size", ctrl->hdr_buffer_size * 2);
@@ -1107,9 +1271,13 @@ static int ndp_ctrl_medusa_attach_ring(struct ndp_channel *channel)
 
 	fdt_setprop_u32(fdt, node_offset, "buffer_size", ctrl->mps.cfg.buffer_size);
 
+	fdt_setprop_u64(fdt, node_offset, "upd_mmap_base", ctrl->upd_mmap_offset);
+	fdt_setprop_u64(fdt, node_offset, "upd_mmap_size", ctrl->update_buffer_size);
+
 	return 0;
 
-	//nfb_char_unregister_mmap(channel->ndp->nfb, ctrl->hdr_mmap_offset);
+err_alloc_desc_table:
+	nfb_char_unregister_mmap(channel->ndp->nfb, ctrl->hdr_mmap_offset);
 err_register_mmap_hdr:
 	vunmap(ctrl->ts.common.hdr_buffer_v);
 err_vmap_hdr_buffer:
@@ -1134,7 +1302,9 @@ err_vmap_desc:
 	ctrl->desc_buffer = NULL;
 
 err_alloc_desc:
-	dma_free_coherent(dev, ALIGN(NDP_CTRL_UPDATE_SIZE, PAGE_SIZE),
+	nfb_char_unregister_mmap(channel->ndp->nfb, ctrl->upd_mmap_offset);
+err_register_mmap_upd:
+	dma_free_coherent(dev, ctrl->update_buffer_size,
 			ctrl->update_buffer, ctrl->update_buffer_phys);
 	ctrl->update_buffer = NULL;
 
@@ -1329,6 +1499,11 @@ static void ndp_ctrl_medusa_detach_ring(struct ndp_channel *channel)
 	struct ndp_ctrl *ctrl = container_of(channel, struct ndp_ctrl, channel);
 	struct device *dev = channel->ring.dev;
 
+	if (ctrl->desc_table) {
+		vfree(ctrl->desc_table);
+		ctrl->desc_table = NULL;
+	}
+
 	if (ctrl->hdr_buffer) {
 		nfb_char_unregister_mmap(channel->ndp->nfb, ctrl->hdr_mmap_offset);
 		vunmap(ctrl->ts.common.hdr_buffer_v);
@@ -1349,7 +1524,8 @@ static void ndp_ctrl_medusa_detach_ring(struct ndp_channel *channel)
 	}
 
 	if (ctrl->update_buffer) {
-		dma_free_coherent(dev, ALIGN(NDP_CTRL_UPDATE_SIZE, PAGE_SIZE),
+		nfb_char_unregister_mmap(channel->ndp->nfb, ctrl->upd_mmap_offset);
+		dma_free_coherent(dev, ctrl->update_buffer_size,
 				ctrl->update_buffer, ctrl->update_buffer_phys);
 		ctrl->update_buffer = NULL;
 	}
@@ -1448,7 +1624,8 @@ static struct ndp_channel *ndp_ctrl_create(struct ndp *ndp, struct ndp_channel_i
 		ndp_ctrl_medusa_req_block_update(ctrl, 0,
 				ndp_buffer_size,
 				ndp_ring_size / ndp_buffer_size,
-				(id.index + 1) * ndp_ctrl_initial_offset);
+				(id.index + 1) * ndp_ctrl_initial_offset,
+				NDP_CTRL_MODE_PACKET_SIMPLE);
 	}
 
 	return channel;
@@ -1517,7 +1694,11 @@ static DEVICE_ATTR(ring_size,   (S_IRUGO | S_IWGRP | S_IWUSR), ndp_ctrl_get_ring
 static DEVICE_ATTR(buffer_size, (S_IRUGO | S_IWGRP | S_IWUSR), ndp_ctrl_get_buffer_size, ndp_ctrl_set_buffer_size);
 static DEVICE_ATTR(buffer_count, (S_IRUGO | S_IWGRP | S_IWUSR), ndp_ctrl_get_buffer_count, ndp_ctrl_set_buffer_count);
 static DEVICE_ATTR(initial_offset, (S_IRUGO | S_IWGRP | S_IWUSR), ndp_ctrl_get_initial_offset, ndp_ctrl_set_initial_offset);
+static DEVICE_ATTR(mode, (S_IRUGO | S_IWGRP | S_IWUSR), ndp_ctrl_get_mode, ndp_ctrl_set_mode);
 static DEVICE_ATTR(timeout, (S_IRUGO | S_IWGRP | S_IWUSR), ndp_ctrl_get_timeout, ndp_ctrl_set_timeout);
+static DEVICE_ATTR(poll_thresh, (S_IRUGO | S_IWGRP | S_IWUSR), ndp_channel_get_poll_thresh, ndp_channel_set_poll_thresh);
+static DEVICE_ATTR(subscriptions, S_IRUGO, ndp_channel_get_subscriptions, NULL);
+static DEVICE_ATTR(tx_quantum, (S_IRUGO | S_IWGRP | S_IWUSR), ndp_channel_get_tx_quantum, ndp_channel_set_tx_quantum);
 
 static struct device_attribute dev_attr_calypte_ring_size = __ATTR(ring_size, (S_IRUGO | S_IWGRP | S_IWUSR), ndp_channel_get_ring_size, ndp_channel_set_ring_size);
 
@@ -1526,7 +1707,10 @@ static struct attribute *ndp_ctrl_rx_attrs[] = {
 	&dev_attr_buffer_size.attr,
 	&dev_attr_buffer_count.attr,
 	&dev_attr_initial_offset.attr,
+	&dev_attr_mode.attr,
 	&dev_attr_timeout.attr,
+	&dev_attr_poll_thresh.attr,
+	&dev_attr_subscriptions.attr,
 	NULL,
 };
 
@@ -1536,6 +1720,7 @@ static struct attribute *ndp_ctrl_tx_attrs[] = {
 	&dev_attr_buffer_count.attr,
 	&dev_attr_initial_offset.attr,
 	&dev_attr_timeout.attr,
+	&dev_attr_tx_quantum.attr,
 	NULL,
 };
 
@@ -1559,11 +1744,14 @@ static const struct attribute_group *ndp_ctrl_attr_tx_groups[] = {
 
 static struct attribute *ndp_ctrl_calypte_rx_attrs[] = {
 	&dev_attr_calypte_ring_size.attr,
+	&dev_attr_poll_thresh.attr,
+	&dev_attr_subscriptions.attr,
 	NULL,
 };
 
 static struct attribute *ndp_ctrl_calypte_tx_attrs[] = {
 	&dev_attr_calypte_ring_size.attr,
+	&dev_attr_tx_quantum.attr,
 	NULL,
 };
 
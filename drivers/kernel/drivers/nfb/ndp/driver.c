@@ -13,6 +13,7 @@
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/interrupt.h>
+#include <linux/kthread.h>
 #include <linux/list.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
@@ -86,9 +87,16 @@ int nfb_ndp_attach(struct nfb_device *nfb, void **priv)
 	mutex_init(&ndp->lock);
 	INIT_LIST_HEAD(&ndp->list_channels);
 	INIT_LIST_HEAD(&ndp->list_subscribers);
+	init_waitqueue_head(&ndp->sync_wait);
 	ndp->nfb = nfb;
 	*priv = ndp;
 
+	ndp->sync_task = kthread_run(ndp_sync_page_thread, ndp, "ndp_sync/%d", nfb->minor);
+	if (IS_ERR(ndp->sync_task)) {
+		ret = PTR_ERR(ndp->sync_task);
+		goto err_kthread_run;
+	}
+
 	device_initialize(&ndp->dev);
 	ndp->dev.parent = ndp->nfb->dev;
 	dev_set_name(&ndp->dev, "ndp");
@@ -116,6 +124,8 @@ int nfb_ndp_attach(struct nfb_device *nfb, void **priv)
 
 //	device_del(&ndp->dev);
 err_device_add:
+	kthread_stop(ndp->sync_task);
+err_kthread_run:
 	kfree(ndp);
 err_alloc:
 	return ret;
@@ -140,6 +150,8 @@ void nfb_ndp_detach(struct nfb_device *nfb, void *priv)
 	}
 	mutex_unlock(&ndp->lock);
 
+	kthread_stop(ndp->sync_task);
+
 	list_for_each_entry_safe(channel, tmp, &ndp->list_channels, list_ndp) {
 		ndp_channel_del(channel);
 	}
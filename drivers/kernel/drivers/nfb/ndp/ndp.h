@@ -19,6 +19,7 @@
 #include <linux/interrupt.h>
 #include <linux/poll.h>
 #include <linux/version.h>
+#include <linux/workqueue.h>
 
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(4,10,0)
 #include <linux/sched.h>
@@ -75,6 +76,22 @@ struct ndp_ring {
 
 struct ndp_ctrl;
 
+/**
+ * struct ndp_subscription_stats - RX subscription statistics
+ *
+ * @lag: data locked by subscription at last sync (hwptr - swptr)
+ * @lag_max: maximal observed lag
+ * @syncs: number of pointer synchronizations
+ * @stalls: syncs, in which the subscription held the channel swptr
+ *          with more than 3/4 of the ring locked
+ */
+struct ndp_subscription_stats {
+	unsigned long lag;
+	unsigned long lag_max;
+	unsigned long long syncs;
+	unsigned long long stalls;
+};
+
 struct ndp_subscription {
 	struct ndp_channel *channel;
 	int status;		// unknown, init, started, stopped, ...
@@ -85,6 +102,14 @@ struct ndp_subscription {
 	unsigned long swptr;
 
 	struct ndp_subscriber *subscriber;
+
+	struct ndp_subscription_sync_page *sync_page;
+	size_t sync_page_offset;
+
+	struct ndp_subscription_stats stats;
+
+	int tx_waiting;
+	unsigned long tx_lock_end;
 };
 
 struct ndp_subscriber {
@@ -93,7 +118,14 @@ struct ndp_subscriber {
 	struct list_head list_head_subscriptions;
 	wait_queue_head_t poll_wait;
 	struct hrtimer poll_timer;
+	struct work_struct poll_work;          /* Checks the channels for the poll_timer */
+	bool poll_stop;                        /* Don't rearm poll_timer, subscriber is going away */
 	unsigned long wake_reason;
+	unsigned long poll_interval;
+	unsigned long poll_interval_min;
+	unsigned long poll_interval_max;
+	pid_t pid;                             /* Process which opened the subscriber, for sysfs */
+	char comm[TASK_COMM_LEN];
 };
 
 struct ndp_channel_ops {
@@ -119,8 +151,12 @@ struct ndp_channel_id {
  * @roffset: offset in ring space
  * @asize: block size * blks (pointers modulo)
  * @timeout: current timeout (for adaptive timeout)
- * @poll_thresh: after how much data wake up applications
+ * @poll_thresh: after how much data wake up applications (bytes for v1, packets for v2/v3)
  * @start_count: how many times it was started
+ * @rx_slowest: started RX subscription with the farthest swptr, which the channel swptr follows
+ * @tx_waiting: number of TX subscriptions waiting for the lock
+ * @tx_lock_start: channel swptr at the time the locked_sub got the lock
+ * @tx_quantum: how much can locked_sub hold while others wait, 0 for quarter of the ring
  * list_app: list_head with
  * list_subscriptions: list_head with active subscriptions
  * list_sd: list item in ndp structure
@@ -131,13 +167,18 @@ struct ndp_channel {
 	spinlock_t lock;
 	struct mutex mutex;
 	struct ndp_subscription *locked_sub;
+	struct ndp_subscription *rx_slowest;
 	uint64_t hwptr;
 	uint64_t swptr;
 	uint64_t ptrmask;
+	uint64_t tx_lock_start;
+	uint64_t tx_quantum;
+	uint32_t tx_waiting;
 
 	uint32_t start_count;
 	uint32_t subscriptions_count;
 	uint32_t flags;
+	uint32_t poll_thresh;
 
 	struct ndp_ring ring;
 
@@ -179,6 +220,10 @@ struct ndp {
 	struct list_head list_subscribers;
 	struct mutex lock;
 
+	struct task_struct *sync_task;
+	wait_queue_head_t sync_wait;
+	unsigned int sync_pages;
+
 	struct device dev;
 
 	int dev_node_warn : 1;
@@ -219,6 +264,11 @@ int ndp_channel_ring_req_block_update_by_size(struct ndp_channel *channel, unsig
 
 ssize_t ndp_channel_get_discard(struct device *dev, struct device_attribute *attr, char *buf);
 ssize_t ndp_channel_set_discard(struct device *dev, struct device_attribute *attr, const char *buf, size_t size);
+ssize_t ndp_channel_get_poll_thresh(struct device *dev, struct device_attribute *attr, char *buf);
+ssize_t ndp_channel_set_poll_thresh(struct device *dev, struct device_attribute *attr, const char *buf, size_t size);
+ssize_t ndp_channel_get_tx_quantum(struct device *dev, struct device_attribute *attr, char *buf);
+ssize_t ndp_channel_set_tx_quantum(struct device *dev, struct device_attribute *attr, const char *buf, size_t size);
+ssize_t ndp_channel_get_subscriptions(struct device *dev, struct device_attribute *attr, char *buf);
 
 int ndp_subscription_start(struct ndp_subscription *sub,
 	struct ndp_subscription_sync *sync);
@@ -228,6 +278,9 @@ int ndp_subscription_sync(struct ndp_subscription *sub,
 		struct ndp_subscription_sync *sync);
 
 size_t ndp_subscription_rx_data_available(struct ndp_subscription *sub);
+int ndp_subscription_map_sync_page(struct ndp_subscription *sub,
+		struct ndp_subscription_mmap *req);
+int ndp_sync_page_thread(void *priv);
 
 int ndp_subscribe_channel(struct ndp_subscription *sub,
 		struct ndp_channel_request *req);
@@ -238,11 +291,14 @@ struct ndp_subscriber *ndp_subscriber_create(struct ndp *ndp);
 void ndp_subscriber_destroy(struct ndp_subscriber *subscriber);
 
 int ndp_subscriber_poll(struct ndp_subscriber *subscriber, struct file *filp, struct poll_table_struct *wait);
+void ndp_subscriber_set_poll(struct ndp_subscriber *subscriber, struct ndp_subscriber_poll *poll);
 
 int ndp_channel_start(struct ndp_subscription *sub);
 int ndp_channel_stop(struct ndp_subscription *sub, int force);
 void ndp_channel_txsync(struct ndp_subscription *sub, struct ndp_subscription_sync *sync);
 void ndp_channel_rxsync(struct ndp_subscription *sub, struct ndp_subscription_sync *sync);
+void ndp_channel_rxsync_page(struct ndp_subscription *sub);
+uint64_t ndp_channel_rx_available(struct ndp_subscription *sub);
 void ndp_channel_sync(struct ndp_subscription *sub, struct ndp_subscription_sync *sync);
 
 extern struct ndp_channel *ndp_channel_create(struct ndp *ndp, struct ndp_channel_ops *ctrl_ops,
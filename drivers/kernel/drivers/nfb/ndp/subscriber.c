@@ -26,45 +26,71 @@
 
 #include "ndp.h"
 
-static size_t ndp_subscriber_new_data(struct ndp_subscriber *subscriber)
+static unsigned int ndp_poll_interval_min = 10;
+static unsigned int ndp_poll_interval_max = 200;
+
+/* Check the subscribed channels for new data; with flush set, any amount of data suffices */
+static int ndp_subscriber_new_data(struct ndp_subscriber *subscriber, bool flush)
 {
-	size_t ret = 0, max;
-	struct ndp_subscription *sub, *max_sub;
+	int ret = 0;
+	size_t avail;
+	struct ndp_subscription *sub;
 
+	mutex_lock(&subscriber->ndp->lock);
 	if (list_empty(&subscriber->list_head_subscriptions)) {
-		return -1;
+		ret = -1;
+		goto out;
 	}
 
-	max = 0;
-	max_sub = NULL;
 	list_for_each_entry(sub, &subscriber->list_head_subscriptions, ndp_subscriber_list_item) {
-		ret = ndp_subscription_rx_data_available(sub);
-		if (ret > max) {
-			max = ret;
-			max_sub = sub;
-			return ret;
+		avail = ndp_subscription_rx_data_available(sub);
+		if (avail == 0)
+			continue;
+		if (flush || avail >= READ_ONCE(sub->channel->poll_thresh)) {
+			ret = 1;
+			break;
 		}
 	}
-
+out:
+	mutex_unlock(&subscriber->ndp->lock);
 	return ret;
 }
 
+/* The channel state can't be read in the hardirq context: check it from the work */
 static enum hrtimer_restart ndp_subscriber_poll_timer(struct hrtimer *timer)
 {
-	int ret;
 	struct ndp_subscriber *subscriber = container_of(timer, struct ndp_subscriber, poll_timer);
 
-	ret = ndp_subscriber_new_data(subscriber);
+	if (!READ_ONCE(subscriber->poll_stop))
+		schedule_work(&subscriber->poll_work);
+	return HRTIMER_NORESTART;
+}
+
+static void ndp_subscriber_poll_work(struct work_struct *work)
+{
+	int ret;
+	unsigned long interval, interval_max;
+	struct ndp_subscriber *subscriber = container_of(work, struct ndp_subscriber, poll_work);
+
+	/* The limits can be changed by the NDP_IOC_POLL ioctl at any time */
+	interval = READ_ONCE(subscriber->poll_interval);
+	interval_max = READ_ONCE(subscriber->poll_interval_max);
+
+	/* Data below the threshold are delivered when the period reaches its maximum */
+	ret = ndp_subscriber_new_data(subscriber, interval >= interval_max);
 	if (ret > 0) {
 		set_bit(NDP_WAKE_RX, &subscriber->wake_reason);
 		wake_up_interruptible(&subscriber->poll_wait);
-		return HRTIMER_NORESTART;
-	} else if (ret < 0) {
-		return HRTIMER_NORESTART;
+		return;
+	} else if (ret < 0 || READ_ONCE(subscriber->poll_stop)) {
+		return;
 	}
 
-	hrtimer_forward(timer, hrtimer_get_expires(timer), ns_to_ktime(200 * 1000));
-	return HRTIMER_RESTART;
+	/* Back off while the channels are idle */
+	interval = min(interval * 2, interval_max);
+	WRITE_ONCE(subscriber->poll_interval, interval);
+
+	hrtimer_start(&subscriber->poll_timer, ns_to_ktime(interval * 1000), HRTIMER_MODE_REL);
 }
 
 /**
@@ -83,10 +109,13 @@ struct ndp_subscriber *ndp_subscriber_create(struct ndp *ndp)
 	}
 
 	subscriber->ndp = ndp;
+	subscriber->pid = task_tgid_nr(current);
+	get_task_comm(subscriber->comm, current);
 
 	INIT_LIST_HEAD(&subscriber->list_head);
 	INIT_LIST_HEAD(&subscriber->list_head_subscriptions);
 	init_waitqueue_head(&subscriber->poll_wait);
+	INIT_WORK(&subscriber->poll_work, ndp_subscriber_poll_work);
 #ifdef CONFIG_HAVE_HRTIMER_SETUP
 	hrtimer_setup(&subscriber->poll_timer, ndp_subscriber_poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
 #else
@@ -95,6 +124,11 @@ struct ndp_subscriber *ndp_subscriber_create(struct ndp *ndp)
 #endif
 	clear_bit(NDP_WAKE_RX, &subscriber->wake_reason);
 
+	/* The period must not be zero, otherwise it can't double while idle */
+	subscriber->poll_interval_min = max(READ_ONCE(ndp_poll_interval_min), 1u);
+	subscriber->poll_interval_max = max_t(unsigned long, READ_ONCE(ndp_poll_interval_max), subscriber->poll_interval_min);
+	subscriber->poll_interval = subscriber->poll_interval_min;
+
 	mutex_lock(&ndp->lock);
 	list_add_tail(&subscriber->list_head, &ndp->list_subscribers);
 	mutex_unlock(&ndp->lock);
@@ -117,7 +151,12 @@ void ndp_subscriber_destroy(struct ndp_subscriber *subscriber)
 
 	ndp = subscriber->ndp;
 
+	/* The work rearms the timer and the timer queues the work: stop both */
+	WRITE_ONCE(subscriber->poll_stop, true);
 	hrtimer_cancel(&subscriber->poll_timer);
+	cancel_work_sync(&subscriber->poll_work);
+	hrtimer_cancel(&subscriber->poll_timer);
+
 	list_for_each_entry_safe(sub, tmp, &subscriber->list_head_subscriptions, ndp_subscriber_list_item) {
 		ndp_subscription_destroy(sub);
 	}
@@ -145,6 +184,7 @@ struct ndp_subscription *ndp_subscription_by_id(struct ndp_subscriber *subscribe
 int ndp_subscriber_poll(struct ndp_subscriber *subscriber, struct file *filp, struct poll_table_struct *wait)
 {
 	int ret;
+	unsigned long interval;
 	ktime_t to;
 
 	ret = test_bit(NDP_WAKE_RX, &subscriber->wake_reason) ? (POLLIN | POLLRDNORM) : 0;
@@ -156,8 +196,38 @@ int ndp_subscriber_poll(struct ndp_subscriber *subscriber, struct file *filp, st
 
 	poll_wait(filp, &subscriber->poll_wait, wait);
 
+	/* Don't wait for the timer when the data are already there */
+	if (ndp_subscriber_new_data(subscriber, false) > 0)
+		return POLLIN | POLLRDNORM;
+
+	interval = READ_ONCE(subscriber->poll_interval_min);
+	WRITE_ONCE(subscriber->poll_interval, interval);
+
 	to = ktime_get();
-	to = ktime_add_ns(to, 200 * 1000);
+	to = ktime_add_ns(to, interval * 1000);
 	hrtimer_start(&subscriber->poll_timer, to, HRTIMER_MODE_ABS);
 	return ret;
 }
+
+/* Zero value keeps the current setting; the timer reads the limits without any lock */
+void ndp_subscriber_set_poll(struct ndp_subscriber *subscriber, struct ndp_subscriber_poll *poll)
+{
+	unsigned long interval_min, interval_max;
+
+	interval_min = poll->interval_min ? poll->interval_min : subscriber->poll_interval_min;
+	interval_max = poll->interval_max ? poll->interval_max : subscriber->poll_interval_max;
+
+	if (interval_max < interval_min)
+		interval_max = interval_min;
+
+	WRITE_ONCE(subscriber->poll_interval_min, interval_min);
+	WRITE_ONCE(subscriber->poll_interval_max, interval_max);
+
+	poll->interval_min = interval_min;
+	poll->interval_max = interval_max;
+}
+
+module_param(ndp_poll_interval_min, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ndp_poll_interval_min, "Default initial period of data check in poll [10]us");
+module_param(ndp_poll_interval_max, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ndp_poll_interval_max, "Default maximal period of data check in poll, doubles from the initial while idle [200]us");
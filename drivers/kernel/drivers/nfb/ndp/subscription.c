@@ -8,25 +8,24 @@
  */
 
 #include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/module.h>
 
 #include "ndp.h"
+#include "../nfb.h"
 
+static unsigned int ndp_sync_page_interval = 20;
+
+/* Caller holds ndp->lock; the result is in the channel pointer units */
 size_t ndp_subscription_rx_data_available(struct ndp_subscription *sub)
 {
-	size_t ret = 0;
-	struct ndp_channel *channel;
-	unsigned long hwptr;
-
-	channel = sub->channel;
-
+	if (sub->status != NDP_SUB_STATUS_RUNNING)
+		return 0;
+	if (sub->channel->id.type != NDP_CHANNEL_TYPE_RX)
 		return 0;
-	if (channel->id.type != NDP_CHANNEL_TYPE_RX)
-		return ret;
-
-	hwptr = channel->ops->get_hwptr(channel);
-	ret = (hwptr - sub->swptr) & (channel->ring.size - 1);
 
-	return ret;
+	return ndp_channel_rx_available(sub);
 }
 
 int ndp_subscription_sync(struct ndp_subscription* sub,
@@ -165,6 +164,110 @@ void ndp_subscription_destroy(struct ndp_subscription *sub)
 
 	mutex_lock(&ndp->lock);
 	list_del(&sub->ndp_subscriber_list_item);
+	if (sub->sync_page) {
+		nfb_char_unregister_mmap(ndp->nfb, sub->sync_page_offset);
+		ndp->sync_pages--;
+	}
 	mutex_unlock(&ndp->lock);
+
+	/* Pages still mapped by the application hold their own reference */
+	if (sub->sync_page)
+		free_page((unsigned long) sub->sync_page);
 	kfree(sub);
 }
+
+static int ndp_subscription_sync_page_mmap(struct vm_area_struct *vma, unsigned long offset, unsigned long size, void *priv)
+{
+	struct ndp_subscription *sub = priv;
+
+	if (size != PAGE_SIZE)
+		return -EINVAL;
+
+	return vm_insert_page(vma, vma->vm_start, virt_to_page(sub->sync_page));
+}
+
+/**
+ * ndp_subscription_map_sync_page - provide the pointer sync page for RX subscription
+ * @sub: subscription
+ * @req: returns the mmap offset and size of the page
+ *
+ * The page is allocated on the first call and lives until the subscription
+ * is destroyed. The ndp_sync_page_thread refreshes pointers of all started
+ * subscriptions with sync page.
+ */
+int ndp_subscription_map_sync_page(struct ndp_subscription *sub,
+		struct ndp_subscription_mmap *req)
+{
+	int ret;
+	struct ndp *ndp = sub->subscriber->ndp;
+	struct ndp_channel *channel = sub->channel;
+	struct ndp_subscription_sync_page *page;
+
+	if (channel->id.type != NDP_CHANNEL_TYPE_RX)
+		return -EOPNOTSUPP;
+
+	mutex_lock(&ndp->lock);
+	if (sub->sync_page == NULL) {
+		page = (struct ndp_subscription_sync_page *) get_zeroed_page(GFP_KERNEL);
+		if (page == NULL) {
+			ret = -ENOMEM;
+			goto err_alloc;
+		}
+
+		ret = nfb_char_register_mmap(ndp->nfb, PAGE_SIZE, &sub->sync_page_offset,
+				ndp_subscription_sync_page_mmap, sub);
+		if (ret)
+			goto err_register_mmap;
+
+		spin_lock_bh(&channel->lock);
+		page->swptr = sub->swptr;
+		page->hwptr = sub->hwptr;
+		sub->sync_page = page;
+		spin_unlock_bh(&channel->lock);
+
+		ndp->sync_pages++;
+		wake_up(&ndp->sync_wait);
+	}
+
+	req->mmap_offset = sub->sync_page_offset;
+	req->mmap_size = PAGE_SIZE;
+	mutex_unlock(&ndp->lock);
+	return 0;
+
+err_register_mmap:
+	free_page((unsigned long) page);
+err_alloc:
+	mutex_unlock(&ndp->lock);
+	return ret;
+}
+
+int ndp_sync_page_thread(void *priv)
+{
+	struct ndp *ndp = priv;
+	struct ndp_subscriber *subscriber;
+	struct ndp_subscription *sub;
+	unsigned int interval;
+
+	while (!kthread_should_stop()) {
+		/* Sleep until some application maps the sync page */
+		wait_event_interruptible(ndp->sync_wait, READ_ONCE(ndp->sync_pages) || kthread_should_stop());
+
+		mutex_lock(&ndp->lock);
+		list_for_each_entry(subscriber, &ndp->list_subscribers, list_head) {
+			list_for_each_entry(sub, &subscriber->list_head_subscriptions, ndp_subscriber_list_item) {
+				if (sub->sync_page)
+					ndp_channel_rxsync_page(sub);
+			}
+		}
+		mutex_unlock(&ndp->lock);
+
+		/* Sleep without the lock, zero interval would make the thread spin */
+		interval = max(READ_ONCE(ndp_sync_page_interval), 1u);
+		usleep_range(interval, interval * 2);
+	}
+
+	return 0;
+}
+
+module_param(ndp_sync_page_interval, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ndp_sync_page_interval, "Period of pointer update in sync pages of shared RX queues, at least 1 [20]us");
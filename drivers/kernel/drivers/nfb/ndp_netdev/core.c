@@ -20,6 +20,7 @@
 
 #include <linux/delay.h>
 #include <linux/kthread.h>
+#include <linux/prefetch.h>
 #include <linux/skbuff.h>
 #include <linux/sched/task.h>
 #include <linux/parser.h>
@@ -30,63 +31,103 @@ static bool ndp_netdev_carrier = 0;
 
 extern unsigned int net_rx_thread_nodata_check_interval_us;
 
+/* Delay before the stopped TX queue is woken to retry on full ring */
+#define NFB_NDP_NETDEV_TX_RESTART_NS (20 * NSEC_PER_USEC)
+
 
 /**
- * nfb_ndp_netdev_rx_thread - thread function for receiving data, works in a poll mode
- * @data: pointer to net_device structure
+ * nfb_ndp_netdev_rx_poll - NAPI poll function, receives bursts of packets
+ * @napi: NAPI structure of the net_device
+ * @budget: maximum number of packets to receive
  */
-static int nfb_ndp_netdev_rx_thread(void *data)
+static int nfb_ndp_netdev_rx_poll(struct napi_struct *napi, int budget)
 {
-	unsigned cnt;
-	struct ndp_packet packet;
+	unsigned cnt, i;
+	int done = 0;
+	struct ndp_packet *packet;
 	struct ndp_queue *q;
 
-	struct net_device *dev = data;
-	struct nfb_ndp_netdev *ethdev;
+	struct nfb_ndp_netdev *ethdev = container_of(napi, struct nfb_ndp_netdev, napi);
+	struct net_device *dev = ethdev->ndev;
 
 	struct sk_buff *skb;
 
-	ethdev = netdev_priv(dev);
 	q = ethdev->rx_q;
 
-	while (!kthread_should_stop()) {
+	while (done < budget) {
 		/* read new data */
-		cnt = ndp_rx_burst_get(q, &packet, 1);
+		cnt = ndp_rx_burst_get(q, ethdev->packets, min_t(unsigned, budget - done, NFB_NDP_NETDEV_BURST_SIZE));
+		if (cnt == 0)
+			break;
 
-		/* no new data, sleep and then try again */
-		if (cnt == 0) {
-			usleep_range(net_rx_thread_nodata_check_interval_us+1,
-					net_rx_thread_nodata_check_interval_us+2);
-			continue;
-		}
+		for (i = 0; i < cnt; i++) {
+			packet = &ethdev->packets[i];
 
-		skb = __netdev_alloc_skb(dev, packet.data_length + NET_IP_ALIGN, GFP_KERNEL);
-		if (!skb) {
-			ethdev->ndev_stats.rx_errors++;
-			ndp_rx_burst_put(q);
-			continue;
-		}
+			/* warm up the next frame in the ring while this one is copied */
+			if (i + 1 < cnt)
+				prefetch(ethdev->packets[i + 1].data);
 
-		skb_reserve(skb, NET_IP_ALIGN);
-		memcpy(skb->data, packet.data, packet.data_length);
+			skb = napi_alloc_skb(napi, packet->data_length);
+			if (!skb) {
+				ethdev->ndev_stats.rx_errors++;
+				continue;
+			}
 
-		skb_put(skb, packet.data_length);
-		skb->protocol = eth_type_trans(skb, dev);
+			memcpy(skb->data, packet->data, packet->data_length);
+
+			skb_put(skb, packet->data_length);
+			skb->protocol = eth_type_trans(skb, dev);
+
+			/* send packet to the kernel network stack */
+			napi_gro_receive(napi, skb);
 
-		/* send packet to the kernel network stack */
-#ifdef CONFIG_HAVE_NETIF_RX_NI
-		if (netif_rx_ni(skb) != NET_RX_DROP) {
-#else
-		if (netif_rx(skb) != NET_RX_DROP) {
-#endif
 			ethdev->ndev_stats.rx_packets++;
-			ethdev->ndev_stats.rx_bytes += packet.data_length;
-		} else {
-			ethdev->ndev_stats.rx_dropped++;
+			ethdev->ndev_stats.rx_bytes += packet->data_length;
 		}
 
-		/* packet is processed, unlock ring buffer */
+		/* burst is processed, unlock ring buffer */
 		ndp_rx_burst_put(q);
+		done += cnt;
+	}
+
+	if (done == budget)
+		return budget;
+
+	ethdev->napi_idle = done == 0;
+	napi_complete_done(napi, done);
+	return done;
+}
+
+/**
+ * nfb_ndp_netdev_rx_thread - thread function for scheduling the NAPI poll, there is no RX interrupt
+ * @data: pointer to net_device structure
+ */
+static int nfb_ndp_netdev_rx_thread(void *data)
+{
+	struct net_device *dev = data;
+	struct nfb_ndp_netdev *ethdev;
+
+	ethdev = netdev_priv(dev);
+
+	while (!kthread_should_stop()) {
+		local_bh_disable();
+		napi_schedule(&ethdev->napi);
+		local_bh_enable();
+
+		while (!kthread_should_stop() && test_bit(NAPI_STATE_SCHED, &ethdev->napi.state))
+			usleep_range(10, 20);
+
+		/* the poll found a corrupted ring: resynchronize the queue while NAPI is idle */
+		if (ndp_queue_get_error(ethdev->rx_q)) {
+			ndp_queue_stop(ethdev->rx_q);
+			ndp_queue_start(ethdev->rx_q);
+		}
+
+		/* no new data, sleep and then try again */
+		if (ethdev->napi_idle) {
+			usleep_range(net_rx_thread_nodata_check_interval_us+1,
+					net_rx_thread_nodata_check_interval_us+2);
+		}
 	}
 
 	return 0;
@@ -182,7 +223,10 @@ static int nfb_ndp_netdev_open(struct net_device *ndev)
 		ret = -ENOMEM;
 		goto err_no_task;
 	}
+	ethdev->napi_idle = false;
+	napi_enable(&ethdev->napi);
 	wake_up_process(ethdev->rx_task);
+	netif_start_queue(ndev);
 
 	return 0;
 
@@ -206,20 +250,38 @@ static int nfb_ndp_netdev_close(struct net_device *ndev)
 	ethdev = netdev_priv(ndev);
 
 	kthread_stop(ethdev->rx_task);
+	napi_disable(&ethdev->napi);
+	/* Wait for the running xmit first, it can arm the restart timer */
+	netif_tx_disable(ndev);
+	hrtimer_cancel(&ethdev->tx_restart_timer);
 	nfb_ndp_netdev_unsub_dma(ethdev, NDP_CHANNEL_TYPE_RX);
 	nfb_ndp_netdev_unsub_dma(ethdev, NDP_CHANNEL_TYPE_TX);
 
 	return 0;
 }
 
+/**
+ * nfb_ndp_netdev_tx_restart_timer - wake the TX queue stopped on full ring
+ * @timer: hrtimer structure of the device
+ */
+static enum hrtimer_restart nfb_ndp_netdev_tx_restart_timer(struct hrtimer *timer)
+{
+	struct nfb_ndp_netdev *ethdev = container_of(timer, struct nfb_ndp_netdev, tx_restart_timer);
+
+	/* The closing interface has the queue disabled, don't wake it again */
+	if (netif_running(ethdev->ndev))
+		netif_wake_queue(ethdev->ndev);
+	return HRTIMER_NORESTART;
+}
+
 /**
  * nfb_ndp_netdev_xmit_dma - transmit packet
  * @skb: structure containing packet data
  */
 static netdev_tx_t nfb_ndp_netdev_xmit_dma(struct sk_buff *skb, struct net_device *dev)
 {
-	int ret;
 	unsigned cnt;
+	bool xmit_more;
 	struct ndp_packet packet;
 	struct ndp_queue *q;
 
@@ -227,41 +289,43 @@ static netdev_tx_t nfb_ndp_netdev_xmit_dma(struct sk_buff *skb, struct net_devic
 	ethdev = netdev_priv(dev);
 	q = ethdev->tx_q;
 
+#ifdef CONFIG_HAVE_NETDEV_XMIT_MORE
+	xmit_more = netdev_xmit_more();
+#else
+	xmit_more = skb->xmit_more;
+#endif
+
 	/* no NDP specific packet metadata */
 	packet.header_length = 0;
 
 	/* packet must have certain minimal size to be transmited by card, if it's smaller it will be padded with zeros */
 	packet.data_length = max_t(unsigned int, skb->len, ETH_ZLEN);
 
-	ret = skb_linearize(skb);
-
-	if (ret) {
-		if (net_ratelimit())
-			printk(KERN_ERR "%s: can't linearize sk_buff: %d\n", __func__, ret);
-
-		ethdev->ndev_stats.tx_errors++;
-		goto free;
-	}
-
 	/* find free space for packet in ring buffer */
 	cnt = ndp_tx_burst_get(q, &packet, 1);
 	if (cnt != 1) {
-		ethdev->ndev_stats.tx_errors++;
-		goto free;
+		/* ring is full: send pending packets, stop the queue and retry later */
+		ndp_tx_burst_flush(q);
+		netif_stop_queue(dev);
+		hrtimer_start(&ethdev->tx_restart_timer, ns_to_ktime(NFB_NDP_NETDEV_TX_RESTART_NS), HRTIMER_MODE_REL);
+		return NETDEV_TX_BUSY;
 	}
 
 	/* padding unused space with zeroes */
 	if (skb->len < ETH_ZLEN)
 		memset(packet.data, 0, packet.data_length);
 
-	memcpy(packet.data, skb->data, skb->len);
-	/* flush function will send packet immediately */
-	ndp_tx_burst_flush(q);
+	/* gather linear part and page fragments directly into the ring */
+	skb_copy_bits(skb, 0, packet.data, skb->len);
+	ndp_tx_burst_put(q);
 
 	ethdev->ndev_stats.tx_packets++;
 	ethdev->ndev_stats.tx_bytes += packet.data_length;
 
-free:
+	/* flush function will send packets, defer it until the last packet of the batch */
+	if (!xmit_more || netif_queue_stopped(dev))
+		ndp_tx_burst_flush(q);
+
 	dev_kfree_skb(skb);
 	return NETDEV_TX_OK;
 }
@@ -390,9 +454,25 @@ static int nfb_ndp_netdev_create(struct nfb_mod_ndp_netdev *eth, int index)
 	ndev->netdev_ops = &ndp_netdev_ops;
 	SET_NETDEV_DEV(ndev, &nfb->pci->dev);
 
+	/* fragmented skbs are gathered directly into the ring, GSO is done by the stack */
+	ndev->hw_features |= NETIF_F_SG | NETIF_F_FRAGLIST;
+	ndev->features |= NETIF_F_SG | NETIF_F_FRAGLIST;
+
 	snprintf(ndev->name, IFNAMSIZ-1, name);
 	nfb_net_set_dev_addr(nfb, ndev, index);
 
+#ifdef CONFIG_HAVE_NETIF_NAPI_ADD_WITH_WEIGHT
+	netif_napi_add(ndev, &ethdev->napi, nfb_ndp_netdev_rx_poll, NAPI_POLL_WEIGHT);
+#else
+	netif_napi_add_weight(ndev, &ethdev->napi, nfb_ndp_netdev_rx_poll, NAPI_POLL_WEIGHT);
+#endif
+#ifdef CONFIG_HAVE_HRTIMER_SETUP
+	hrtimer_setup(&ethdev->tx_restart_timer, nfb_ndp_netdev_tx_restart_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&ethdev->tx_restart_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ethdev->tx_restart_timer.function = nfb_ndp_netdev_tx_restart_timer;
+#endif
+
 	ret = register_netdev(ndev);
 	if (ret) {
 		printk(KERN_ERR "%s: failed to register netdev %d\n", __func__, index);
@@ -412,6 +492,7 @@ static int nfb_ndp_netdev_create(struct nfb_mod_ndp_netdev *eth, int index)
 
 	unregister_netdev(ethdev->ndev);
 err_register_netdev:
+	netif_napi_del(&ethdev->napi);
 	device_del(&ethdev->device);
 err_device_add:
 	free_netdev(ndev);
@@ -429,6 +510,7 @@ static void nfb_ndp_netdev_destroy(struct nfb_ndp_netdev *ethdev)
 	list_del(&ethdev->list_item);
 
 	unregister_netdev(ethdev->ndev);
+	netif_napi_del(&ethdev->napi);
 	device_del(&ethdev->device);
 	free_netdev(ethdev->ndev);
 }
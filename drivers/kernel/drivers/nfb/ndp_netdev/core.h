@@ -23,6 +23,8 @@ struct nfb_mod_ndp_netdev {
 	struct device dev;
 };
 
+#define NFB_NDP_NETDEV_BURST_SIZE 32
+
 struct nfb_ndp_netdev {
 	struct nfb_device *nfb;
 	struct nfb_mod_ndp_netdev *eth;
@@ -32,6 +34,10 @@ struct nfb_ndp_netdev {
 	struct ndp_queue *rx_q;
 	int index;
 	struct task_struct *rx_task;
+	struct napi_struct napi;
+	bool napi_idle;
+	struct hrtimer tx_restart_timer;
+	struct ndp_packet packets[NFB_NDP_NETDEV_BURST_SIZE];
 	struct net_device_stats ndev_stats;
 	struct device device;
 };
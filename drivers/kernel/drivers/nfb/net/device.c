@@ -20,6 +20,7 @@
 #include <linux/mdio.h>
 #include <linux/kernel.h>
 #include <linux/kthread.h>
+#include <linux/prefetch.h>
 #include <linux/if_vlan.h>
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
@@ -69,6 +70,9 @@ unsigned int net_rx_thread_nodata_check_interval_us = 1000;
 module_param(net_rx_thread_nodata_check_interval_us, uint, S_IRUGO);
 MODULE_PARM_DESC(net_rx_thread_nodata_check_interval_us, "Default TX DMA queues offset [1000]us");
 
+/* Delay before the stopped TX queue is woken to retry on full ring */
+#define NFB_NET_TX_RESTART_NS (20 * NSEC_PER_USEC)
+
 
 static void nfb_net_link_status(struct net_device *netdev)
 {
@@ -410,65 +414,99 @@ static int nfb_net_mdio_write(struct net_device *netdev, int prtad, int devad, u
 }
 
 
-static int nfb_net_rx_thread(void *rxqptr)
+static int nfb_net_rx_poll(struct napi_struct *napi, int budget)
 {
-	struct nfb_net_queue *rxq = rxqptr;
-	struct nfb_net_device *priv = rxq->priv;
-	struct net_device *netdev = priv->netdev;
+	struct nfb_net_queue *rxq = container_of(napi, struct nfb_net_queue, napi);
+	struct net_device *netdev = rxq->priv->netdev;
 
 	struct ndp_queue *queue = rxq->ndpq;
-	struct ndp_packet packet;
+	struct ndp_packet *packet;
 
 	struct sk_buff *skb;
-	unsigned received;
+	unsigned received, i;
+	int done = 0;
 
-	while (!kthread_should_stop()) {
+	u64 packets = 0, bytes = 0, errors = 0;
 
+	while (done < budget) {
 		// Get a burst of NDP packets
-		received = ndp_rx_burst_get(queue, &packet, 1);
+		received = ndp_rx_burst_get(queue, rxq->packets, min_t(unsigned, budget - done, NFB_NET_BURST_SIZE));
+		if (received == 0)
+			break;
 
-		// If no data, sleep and try again
-		if (received == 0) {
-			usleep_range(net_rx_thread_nodata_check_interval_us+1,
-					net_rx_thread_nodata_check_interval_us+2);
-			continue;
-		}
+		for (i = 0; i < received; i++) {
+			packet = &rxq->packets[i];
 
-		skb = __netdev_alloc_skb(netdev, packet.data_length + NET_IP_ALIGN, GFP_KERNEL);
-		if (!skb) {
-			u64_stats_update_begin(&rxq->sync);
-			rxq->errors++;
-			u64_stats_update_end(&rxq->sync);
-			ndp_rx_burst_put(queue);
-			continue;
-		}
+			// Warm up the next frame in the ring while this one is copied
+			if (i + 1 < received)
+				prefetch(rxq->packets[i + 1].data);
 
-		skb_reserve(skb, NET_IP_ALIGN);
-		memcpy(skb->data, packet.data, packet.data_length);
+			// The skb data are allocated from the per-CPU page fragment cache
+			skb = napi_alloc_skb(napi, packet->data_length);
+			if (!skb) {
+				errors++;
+				continue;
+			}
 
-		skb_put(skb, packet.data_length);
-		skb->protocol = eth_type_trans(skb, netdev);
+			memcpy(skb->data, packet->data, packet->data_length);
 
-		skb_record_rx_queue(skb, rxq->index);
+			skb_put(skb, packet->data_length);
+			skb->protocol = eth_type_trans(skb, netdev);
 
-		// Send packet to the kernel network stack
-#ifdef CONFIG_HAVE_NETIF_RX_NI
-		if (netif_rx_ni(skb) != NET_RX_DROP) {
-#else
-		if (netif_rx(skb) != NET_RX_DROP) {
-#endif
-			u64_stats_update_begin(&rxq->sync);
-			rxq->packets++;
-			rxq->bytes += packet.data_length;
-			u64_stats_update_end(&rxq->sync);
-		} else {
-			u64_stats_update_begin(&rxq->sync);
-			rxq->dropped++;
-			u64_stats_update_end(&rxq->sync);
+			skb_record_rx_queue(skb, rxq->index);
+
+			// Send packet to the kernel network stack
+			napi_gro_receive(napi, skb);
+
+			packets++;
+			bytes += packet->data_length;
 		}
 
-		// Packet is processed, unlock ring buffer
+		// Burst is processed, unlock ring buffer
 		ndp_rx_burst_put(queue);
+		done += received;
+	}
+
+	u64_stats_update_begin(&rxq->sync);
+	rxq->packets += packets;
+	rxq->bytes += bytes;
+	rxq->errors += errors;
+	u64_stats_update_end(&rxq->sync);
+
+	if (done == budget)
+		return budget;
+
+	rxq->napi_idle = done == 0;
+	napi_complete_done(napi, done);
+	return done;
+}
+
+
+static int nfb_net_rx_thread(void *rxqptr)
+{
+	struct nfb_net_queue *rxq = rxqptr;
+	struct napi_struct *napi = &rxq->napi;
+
+	// The card doesn't raise RX interrupts, the thread schedules the NAPI instead
+	while (!kthread_should_stop()) {
+		local_bh_disable();
+		napi_schedule(napi);
+		local_bh_enable();
+
+		while (!kthread_should_stop() && test_bit(NAPI_STATE_SCHED, &napi->state))
+			usleep_range(10, 20);
+
+		// The poll found a corrupted ring: resynchronize the queue while NAPI is idle
+		if (ndp_queue_get_error(rxq->ndpq)) {
+			ndp_queue_stop(rxq->ndpq);
+			ndp_queue_start(rxq->ndpq);
+		}
+
+		// If no data, sleep and try again
+		if (rxq->napi_idle) {
+			usleep_range(net_rx_thread_nodata_check_interval_us+1,
+					net_rx_thread_nodata_check_interval_us+2);
+		}
 	}
 
 	return 0;
@@ -485,6 +523,7 @@ static void nfb_net_transmission_off(struct net_device *netdev)
 		if (priv->rxqs[i].task != NULL) {
 			kthread_stop(priv->rxqs[i].task);
 			priv->rxqs[i].task = NULL;
+			napi_disable(&priv->rxqs[i].napi);
 		}
 
 		if (priv->rxqs[i].ndpq != NULL) {
@@ -493,8 +532,11 @@ static void nfb_net_transmission_off(struct net_device *netdev)
 		}
 	}
 
-	// Stop all TX queues
-	netif_tx_stop_all_queues(netdev);
+	// Stop all TX queues; netif_tx_disable waits for the running xmits,
+	// so nothing can arm the restart timers after they are cancelled
+	netif_tx_disable(netdev);
+	for (i = 0; i < priv->txqs_count; i++)
+		hrtimer_cancel(&priv->txqs[i].restart_timer);
 	for (i = 0; i < priv->txqs_count; i++) {
 		if (priv->txqs[i].ndpq != NULL) {
 			ndp_close_queue(priv->txqs[i].ndpq);
@@ -591,9 +633,13 @@ static int nfb_net_transmission_on(struct net_device *netdev)
 			printk(KERN_ERR "%s: %s - failed to create rx thread (error: %ld, channel: %d)\n",
 				__func__, netdev->name, PTR_ERR(priv->rxqs[i].task), i);
 			ret = PTR_ERR(priv->rxqs[i].task);
+			priv->rxqs[i].task = NULL;
 			goto err_kthread_create;
 		}
 
+		priv->rxqs[i].napi_idle = false;
+		napi_enable(&priv->rxqs[i].napi);
+
 		// Wake up thread
 		wake_up_process(priv->rxqs[i].task);
 	}
@@ -609,28 +655,37 @@ err_kthread_create:
 }
 
 
+static enum hrtimer_restart nfb_net_tx_restart_timer(struct hrtimer *timer)
+{
+	struct nfb_net_queue *txq = container_of(timer, struct nfb_net_queue, restart_timer);
+	struct net_device *netdev = txq->priv->netdev;
+
+	// Let the stack retry, the queue is stopped again if the ring is still full.
+	// The interface going down has its queues disabled, don't wake them again.
+	if (netif_running(netdev))
+		netif_tx_wake_queue(netdev_get_tx_queue(netdev, txq->index));
+	return HRTIMER_NORESTART;
+}
+
+
 static netdev_tx_t nfb_start_xmit(struct sk_buff *skb, struct net_device *netdev)
 {
 	struct nfb_net_device *priv = netdev_priv(netdev);
 	struct nfb_net_queue *txq = &priv->txqs[skb->queue_mapping];
+	struct netdev_queue *nq = netdev_get_tx_queue(netdev, skb->queue_mapping);
 
 	struct ndp_packet packet;
 	unsigned cnt;
-	int ret;
+	bool xmit_more;
 
 	if (priv->txqs_count == 0)
 		goto free;
 
-	ret = skb_linearize(skb);
-	if (ret) {
-		if (net_ratelimit())
-			printk(KERN_ERR "%s: %s - can't linearize sk_buff (error: %d)\n", __func__, netdev->name, ret);
-
-		u64_stats_update_begin(&txq->sync);
-		txq->errors++;
-		u64_stats_update_end(&txq->sync);
-		goto free;
-	}
+#ifdef CONFIG_HAVE_NETDEV_XMIT_MORE
+	xmit_more = netdev_xmit_more();
+#else
+	xmit_more = skb->xmit_more;
+#endif
 
 	// No specific packet metadata, TODO add output interface
 	packet.header_length = 0;
@@ -641,18 +696,18 @@ static netdev_tx_t nfb_start_xmit(struct sk_buff *skb, struct net_device *netdev
 	// Allocate free space for packet in ring buffer
 	cnt = ndp_tx_burst_get(txq->ndpq, &packet, 1);
 	if (cnt != 1) {
-		u64_stats_update_begin(&txq->sync);
-		txq->errors++;
-		u64_stats_update_end(&txq->sync);
-		goto free;
+		// Ring is full: send what is pending and retry later
+		ndp_tx_burst_flush(txq->ndpq);
+		netif_tx_stop_queue(nq);
+		hrtimer_start(&txq->restart_timer, ns_to_ktime(NFB_NET_TX_RESTART_NS), HRTIMER_MODE_REL);
+		return NETDEV_TX_BUSY;
 	}
 
-	// Copy packet with optional zeroes padding
+	// Gather linear part and page fragments with optional zeroes padding
 	if (skb->len < ETH_ZLEN) memset(packet.data, 0, packet.data_length);
-	memcpy(packet.data, skb->data, skb->len);
+	skb_copy_bits(skb, 0, packet.data, skb->len);
 
-	// Flush to send immediately
-	ndp_tx_burst_flush(txq->ndpq);
+	ndp_tx_burst_put(txq->ndpq);
 
 	// Update stats
 	u64_stats_update_begin(&txq->sync);
@@ -660,6 +715,10 @@ static netdev_tx_t nfb_start_xmit(struct sk_buff *skb, struct net_device *netdev
 	txq->bytes += packet.data_length;
 	u64_stats_update_end(&txq->sync);
 
+	// Defer the flush until the last packet of the batch
+	if (!xmit_more || netif_xmit_stopped(nq))
+		ndp_tx_burst_flush(txq->ndpq);
+
 free:
 	dev_kfree_skb(skb);
 	return NETDEV_TX_OK;
@@ -755,11 +814,22 @@ static int nfb_net_queues_init(struct net_device *netdev)
 	for (i = 0; i < priv->module->rxqc; i++) {
 		priv->rxqs[i].priv = priv;
 		priv->rxqs[i].index = i;
+#ifdef CONFIG_HAVE_NETIF_NAPI_ADD_WITH_WEIGHT
+		netif_napi_add(netdev, &priv->rxqs[i].napi, nfb_net_rx_poll, NAPI_POLL_WEIGHT);
+#else
+		netif_napi_add_weight(netdev, &priv->rxqs[i].napi, nfb_net_rx_poll, NAPI_POLL_WEIGHT);
+#endif
 	}
 
 	for (i = 0; i < priv->module->txqc; i++) {
 		priv->txqs[i].priv = priv;
 		priv->txqs[i].index = i;
+#ifdef CONFIG_HAVE_HRTIMER_SETUP
+		hrtimer_setup(&priv->txqs[i].restart_timer, nfb_net_tx_restart_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+		hrtimer_init(&priv->txqs[i].restart_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		priv->txqs[i].restart_timer.function = nfb_net_tx_restart_timer;
+#endif
 	}
 
 	return 0;
@@ -774,6 +844,10 @@ err_alloc_rxqs:
 static void nfb_net_queues_deinit(struct net_device *netdev)
 {
 	struct nfb_net_device *priv = netdev_priv(netdev);
+	unsigned i;
+
+	for (i = 0; i < priv->module->rxqc; i++)
+		netif_napi_del(&priv->rxqs[i].napi);
 
 	// Free RX & TX queue structures
 	kfree(priv->rxqs);
@@ -881,6 +955,10 @@ struct nfb_net_device *nfb_net_device_create(struct nfb_net *module, int fdt_off
 
 	netdev->netdev_ops = &netdev_ops;
 	nfb_net_set_ethtool_ops(netdev);
+
+	// Fragmented skbs are gathered directly into the ring, GSO is done by the stack
+	netdev->hw_features |= NETIF_F_SG | NETIF_F_FRAGLIST;
+	netdev->features |= NETIF_F_SG | NETIF_F_FRAGLIST;
 	SET_NETDEV_DEV(netdev, &nfbdev->pci->dev);
 
 	nfb_net_set_dev_addr(nfbdev, netdev, index);
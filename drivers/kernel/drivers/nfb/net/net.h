@@ -58,6 +58,8 @@ enum nfb_net_device_state {
 	NFBNET_SERVICE_SCHED,
 };
 
+#define NFB_NET_BURST_SIZE 32
+
 struct nfb_net_queue {
 	struct nfb_net_device *priv;
 	struct task_struct *task;
@@ -66,6 +68,11 @@ struct nfb_net_queue {
 
 	unsigned index;
 
+	struct napi_struct napi;
+	bool napi_idle;
+	struct hrtimer restart_timer;
+	struct ndp_packet packets[NFB_NET_BURST_SIZE];
+
 	struct u64_stats_sync sync;
 	u64 packets;
 	u64 dropped;
@@ -13,6 +13,9 @@
 #include <asm/atomic.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
+#include <linux/hashtable.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
 
 #include <linux/nfb/nfb.h>
 
@@ -32,6 +35,8 @@
 
 #define MAX_FDT_PATH_LENGTH 512
 
+#define NFB_LOCK_HASH_BITS    6
+
 enum nfb_device_status {NFB_DEVICE_STATUS_INIT, NFB_DEVICE_STATUS_OK, NFB_DEVICE_STATUS_RELEASE};
 enum nfb_driver_status {NFB_DRIVER_STATUS_NONE, NFB_DRIVER_STATUS_OK, NFB_DRIVER_STATUS_ERROR};
 
@@ -100,10 +105,29 @@ struct nfb_app {
 };
 
 struct nfb_lock_item {
-	struct list_head list;
+	struct hlist_node node;
 	struct nfb_app *app;
 	char *path;
+	u32 hash;
 	int features;
+	ktime_t locked_at;
+};
+
+/* Waiters for the components hashed into one lock_table bucket */
+struct nfb_lock_waitq {
+	wait_queue_head_t wait;
+	atomic_t seq;                          /* Incremented on every unlock in the bucket */
+};
+
+struct nfb_lock_stats {
+	unsigned long locked;                  /* Granted lock requests */
+	unsigned long contended;               /* Requests refused, some features were held by another app */
+	unsigned long waits;                   /* Blocking requests which had to sleep */
+	unsigned long timeouts;                /* Blocking requests which timed out */
+	u64 wait_ns;
+	u64 wait_max_ns;
+	u64 hold_ns;
+	u64 hold_max_ns;
 };
 
 /*
@@ -138,7 +162,9 @@ struct nfb_device {
 	struct list_head pci_devices;          /* Associated PCI device (master+slaves); struct nfb_pci_device type */
 
 	struct mutex lock_mutex;
-	struct list_head lock_list;
+	DECLARE_HASHTABLE(lock_table, NFB_LOCK_HASH_BITS); /* Locked components, hashed by path */
+	struct nfb_lock_waitq lock_wait[1 << NFB_LOCK_HASH_BITS]; /* Unlock waiters, one per lock_table bucket */
+	struct nfb_lock_stats lock_stats;
 };
 
 #define NFB_IS_SILICOM(nfb) ((nfb)->pci->vendor == 0x1c2c)
@@ -254,6 +280,8 @@ void nfb_lock_release(struct nfb_device *nfb, struct nfb_app *app);
 long nfb_lock_ioctl(struct nfb_device *nfb, struct nfb_app *app, unsigned int cmd, unsigned long arg);
 
 int nfb_lock_try_lock(struct nfb_device *nfb, struct nfb_app *app, struct nfb_lock lock);
+int nfb_lock_lock(struct nfb_device *nfb, struct nfb_app *app, struct nfb_lock lock, int timeout, bool intr);
+ssize_t nfb_lock_get_stats(struct nfb_device *nfb, char *buf);
 int nfb_lock_unlock(struct nfb_device *nfb, struct nfb_app *app, struct nfb_lock lock);
 
 int nfb_net_set_dev_addr(struct nfb_device *nfb, struct net_device *dev, int index);
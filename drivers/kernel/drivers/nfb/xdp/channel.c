@@ -12,119 +12,78 @@
 #include "channel.h"
 #include "ethdev.h"
 
-static int nfb_xdp_rx_thread(void *rxqptr)
+static enum hrtimer_restart nfb_xdp_kick_timer(struct hrtimer *timer)
 {
-	struct nfb_ethdev *ethdev;
-	struct net_device *netdev;
-	struct nfb_xdp_queue *rxq;
-	struct nfb_xdp_channel *channel;
-	struct napi_struct *napi;
-	int ret;
-
-	rxq = rxqptr;
-	channel = container_of(rxq, struct nfb_xdp_channel, rxq);
-	ethdev = channel->ethdev;
-	netdev = ethdev->netdev;
-	napi = &rxq->napi;
-	ret = 0;
-
-	while (!kthread_should_stop()) {
-		local_bh_disable();
-		napi_schedule(napi);
-		local_bh_enable();
-		while (!kthread_should_stop() && test_bit(NAPI_STATE_SCHED, &napi->state))
-			usleep_range(10, 20);
-	}
-	return ret;
+	struct nfb_xdp_queue *q = container_of(timer, struct nfb_xdp_queue, kick_timer);
+
+	napi_schedule(&q->napi);
+	return HRTIMER_NORESTART;
 }
 
-static int nfb_xdp_tx_thread(void *txqptr)
+/**
+ * channel_napi_rearm - schedule the next napi run of a queue
+ * @q: queue whose napi has just completed
+ * @work: amount of work done by the completed napi run
+ *
+ * The firmware doesn't raise DMA interrupts, so the napi is scheduled from a timer.
+ * The period starts at the minimum while the queue is busy and doubles
+ * up to the maximum while the queue is idle.
+ */
+void channel_napi_rearm(struct nfb_xdp_queue *q, int work)
 {
-	struct nfb_ethdev *ethdev;
-	struct net_device *netdev;
-	struct nfb_xdp_queue *txq;
-	struct nfb_xdp_channel *channel;
-	struct napi_struct *napi;
-	int ret;
-
-	txq = txqptr;
-	channel = container_of(txq, struct nfb_xdp_channel, txq);
-	ethdev = channel->ethdev;
-	netdev = ethdev->netdev;
-	napi = &txq->napi;
-	ret = 0;
-
-	if (!test_bit(NFB_STATUS_IS_XSK, &channel->status)) // In page pool mode tx exits
-		return ret;
-
-	while (!kthread_should_stop()) {
-		local_bh_disable();
-		napi_schedule(napi);
-		local_bh_enable();
-		while (!kthread_should_stop() && test_bit(NAPI_STATE_SCHED, &napi->state))
-			usleep_range(10, 20);
-	}
-	return ret;
+	struct nfb_ethdev *ethdev = netdev_priv(q->napi.dev);
+	u32 usecs;
+
+	// Queue is being stopped, the poll may still run after napi_complete_done
+	if (READ_ONCE(q->kick_stopping))
+		return;
+
+	if (work)
+		usecs = READ_ONCE(ethdev->kick_usecs_min);
+	else
+		usecs = min(q->kick_usecs * 2, READ_ONCE(ethdev->kick_usecs_max));
+
+	q->kick_usecs = usecs;
+	hrtimer_start(&q->kick_timer, ns_to_ktime((u64)usecs * NSEC_PER_USEC), HRTIMER_MODE_REL);
 }
 
-static int channel_create_threads(struct nfb_xdp_channel *channel)
+static void channel_queue_start_kick(struct nfb_xdp_queue *q, u32 usecs)
 {
-	int ret = 0;
-	struct net_device *netdev = channel->ethdev->netdev;
+#ifdef CONFIG_HAVE_HRTIMER_SETUP
+	hrtimer_setup(&q->kick_timer, nfb_xdp_kick_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&q->kick_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	q->kick_timer.function = nfb_xdp_kick_timer;
+#endif
+	q->kick_usecs = usecs;
+	WRITE_ONCE(q->kick_stopping, false);
+	napi_enable(&q->napi);
+	hrtimer_start(&q->kick_timer, ns_to_ktime((u64)usecs * NSEC_PER_USEC), HRTIMER_MODE_REL);
+}
 
-	// Create RX thread for each queue
-	channel->rxq.thread = kthread_create_on_node(nfb_xdp_rx_thread, &channel->rxq, channel->numa, "%s/%u", netdev->name, channel->nfb_index);
-	if (IS_ERR(channel->rxq.thread)) {
-		printk(KERN_ERR "nfb: %s - failed to create rx thread (error: %ld, channel: %d)\n",
-		       netdev->name, PTR_ERR(channel->rxq.thread), channel->nfb_index);
-		ret = PTR_ERR(channel->rxq.thread);
-		goto err_kthread_rx;
-	}
-	// Increment reference counter to kthread so the thread can exit on error and kthread_stop() won't crash
-	// put_task_struct() must be called after kthread_stop()
-	get_task_struct(channel->rxq.thread);
-	// Enable napi
-	napi_enable(&channel->rxq.napi);
-	// Wake up thread
-	wake_up_process(channel->rxq.thread);
-
-	// Create TX thread for each queue
-	channel->txq.thread = kthread_create_on_node(nfb_xdp_tx_thread, &channel->txq, channel->numa, "%s/%u", netdev->name, channel->nfb_index);
-	if (IS_ERR(channel->txq.thread)) {
-		printk(KERN_ERR "nfb: %s - failed to create tx thread (error: %ld, channel: %d)\n",
-		       netdev->name, PTR_ERR(channel->txq.thread), channel->nfb_index);
-		ret = PTR_ERR(channel->txq.thread);
-		goto err_kthread_tx;
-	}
-	// increment reference counter to struct_task so the thread can exit on error and kthread_stop() won't crash
-	// put_task_struct() must be called after kthread_stop() on driver detach
-	get_task_struct(channel->txq.thread);
-	// Enable napi
-	if (!test_bit(NFB_STATUS_IS_XSK, &channel->status)) {
-		// pagepool doesn't use tx napi
-	} else {
-		napi_enable(&channel->txq.napi);
-	}
-	netif_tx_start_queue(netdev_get_tx_queue(netdev, channel->index));
-	// Wake up thread
-	wake_up_process(channel->txq.thread);
-
-	return 0;
-
-err_kthread_tx:
-	// collect rx thread
-	if (channel->rxq.thread != NULL) {
-		kthread_stop(channel->rxq.thread);
-		// This invalidates the task_struct reference
-		put_task_struct(channel->rxq.thread);
-		channel->rxq.thread = NULL;
-	}
-	napi_disable(&channel->rxq.napi);
-	while (napi_disable_pending(&channel->rxq.napi))
+static void channel_queue_stop_kick(struct nfb_xdp_queue *q)
+{
+	// Disabled napi can't be scheduled, but a poll which already called
+	// napi_complete_done can still be running: wait for it before the cancel
+	WRITE_ONCE(q->kick_stopping, true);
+	napi_disable(&q->napi);
+	while (napi_disable_pending(&q->napi))
 		;
+	synchronize_net();
+	hrtimer_cancel(&q->kick_timer);
+}
 
-err_kthread_rx:
-	return ret;
+static void channel_start_napi(struct nfb_xdp_channel *channel)
+{
+	struct nfb_ethdev *ethdev = channel->ethdev;
+	struct net_device *netdev = ethdev->netdev;
+	u32 usecs = READ_ONCE(ethdev->kick_usecs_min);
+
+	channel_queue_start_kick(&channel->rxq, usecs);
+	// pagepool doesn't use tx napi
+	if (test_bit(NFB_STATUS_IS_XSK, &channel->status))
+		channel_queue_start_kick(&channel->txq, usecs);
+	netif_tx_start_queue(netdev_get_tx_queue(netdev, channel->index));
 }
 
 int channel_start_pp(struct nfb_xdp_channel *channel)
@@ -172,16 +131,12 @@ int channel_start_pp(struct nfb_xdp_channel *channel)
 		}
 
 		clear_bit(NFB_STATUS_IS_XSK, &channel->status);
-		if ((ret = channel_create_threads(channel))) {
-			printk(KERN_ERR "nfb: %s - failed to create queue threads %d (error: %d)\n", netdev->name, channel->nfb_index, ret);
-			goto err_threads;
-		}
+		channel_start_napi(channel);
 		set_bit(NFB_STATUS_IS_RUNNING, &channel->status);
 	}
 	mutex_unlock(&channel->state_mutex);
 	return ret;
 
-err_threads:
 err_start_tx:
 err_start_rx:
 	nfb_xctrl_destroy_pp(txq->ctrl);
@@ -244,16 +199,13 @@ int channel_start_xsk(struct nfb_xdp_channel *channel)
 		}
 
 		set_bit(NFB_STATUS_IS_XSK, &channel->status);
-		if ((ret = channel_create_threads(channel))) {
-			goto err_threads;
-		}
+		channel_start_napi(channel);
 		set_bit(NFB_STATUS_IS_RUNNING, &channel->status);
 	}
 	mutex_unlock(&channel->state_mutex);
 
 	return ret;
 
-err_threads:
 err_start_tx:
 err_start_rx:
 	nfb_xctrl_destroy_xsk(txq->ctrl);
@@ -283,31 +235,13 @@ int channel_stop(struct nfb_xdp_channel *channel)
 			goto err_channel_not_running;
 		}
 
-		// Collect rx thread
-		if (rxq->thread != NULL) {
-			kthread_stop(rxq->thread);
-			// This invalidates the task_struct reference
-			put_task_struct(rxq->thread);
-			rxq->thread = NULL;
-		}
-		napi_disable(&rxq->napi);
-		while (napi_disable_pending(&rxq->napi))
-			;
+		channel_queue_stop_kick(rxq);
 		netif_napi_del(&rxq->napi);
 
-		// Collect tx thread
 		netif_tx_stop_queue(netdev_get_tx_queue(netdev, channel->index));
-		if (channel->txq.thread != NULL) {
-			kthread_stop(channel->txq.thread);
-			put_task_struct(channel->txq.thread);
-			channel->txq.thread = NULL;
-		}
-		if (!test_bit(NFB_STATUS_IS_XSK, &channel->status)) {
-			// Only xsk uses tx napi
-		} else {
-			napi_disable(&txq->napi);
-			while (napi_disable_pending(&txq->napi))
-				;
+		// Only xsk uses tx napi
+		if (test_bit(NFB_STATUS_IS_XSK, &channel->status)) {
+			channel_queue_stop_kick(txq);
 			netif_napi_del(&txq->napi);
 		}
 
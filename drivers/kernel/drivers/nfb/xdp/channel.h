@@ -11,18 +11,45 @@
 #define NFB_XDP_CHANNEL_H
 
 #include <linux/netdevice.h>
+#include <linux/hrtimer.h>
+#include <linux/u64_stats_sync.h>
 
 #define NFB_XDP_DESC_CNT 8192
 
+// Default bounds of the NAPI kick period in us, see channel_napi_rearm()
+#define NFB_XDP_KICK_USECS_MIN 10
+#define NFB_XDP_KICK_USECS_MAX 200
+
+// queue counters, written only from the napi (rx) or under the tx_lock (tx)
+struct nfb_xdp_queue_stats {
+	u64 packets;
+	u64 bytes;
+	// rx only
+	u64 xdp_pass;
+	u64 xdp_drop;
+	u64 xdp_tx;
+	u64 xdp_redirect;
+	u64 xdp_aborted;
+	u64 alloc_fail; // buffer allocation failed, in AF_XDP mode the fill ring is empty
+	// tx only
+	u64 busy; // frames dropped because of full descriptor ring
+	struct u64_stats_sync syncp;
+};
+
 struct nfb_xdp_queue {
 	// dma controller
 	struct xctrl *ctrl;
 
-	// queue thread
-	struct task_struct *thread;
+	// timer scheduling the napi, there are no DMA interrupts
+	struct hrtimer kick_timer;
+	u32 kick_usecs; // current kick period, backs off while idle
+	bool kick_stopping; // the finishing napi run must not rearm the kick_timer
 
 	// napi structs - so far only xsk mode uses tx napi
 	struct napi_struct napi;
+
+	// kept over the queue restarts
+	struct nfb_xdp_queue_stats stats;
 };
 
 // structure describing one queue pair
@@ -47,5 +74,28 @@ struct nfb_xdp_channel {
 int channel_start_pp(struct nfb_xdp_channel *channel);
 int channel_start_xsk(struct nfb_xdp_channel *channel);
 int channel_stop(struct nfb_xdp_channel *channel);
+void channel_napi_rearm(struct nfb_xdp_queue *q, int work);
+
+static inline void nfb_xdp_stats_add(struct nfb_xdp_queue_stats *stats, u32 packets, u32 bytes)
+{
+	u64_stats_update_begin(&stats->syncp);
+	stats->packets += packets;
+	stats->bytes += bytes;
+	u64_stats_update_end(&stats->syncp);
+}
+
+static inline void nfb_xdp_stats_inc_busy(struct nfb_xdp_queue_stats *stats)
+{
+	u64_stats_update_begin(&stats->syncp);
+	stats->busy++;
+	u64_stats_update_end(&stats->syncp);
+}
+
+static inline void nfb_xdp_stats_inc_alloc_fail(struct nfb_xdp_queue_stats *stats)
+{
+	u64_stats_update_begin(&stats->syncp);
+	stats->alloc_fail++;
+	u64_stats_update_end(&stats->syncp);
+}
 
 #endif // NFB_XDP_CHANNEL_H
@@ -23,6 +23,19 @@
 
 #define NFB_XDP_CTRL_PACKET_BURST 64
 #define NFB_PP_MAX_FRAME_LEN  PAGE_SIZE - XDP_PACKET_HEADROOM - SKB_DATA_ALIGN(sizeof(struct skb_shared_info))
+// Smallest page pool fragment, keeps at least ETH_ZLEN of frame data in one buffer
+#define NFB_PP_FRAG_SIZE_MIN 1024
+#define NFB_PP_FRAME_LEN(frag_size) ((frag_size) - XDP_PACKET_HEADROOM - SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
+
+/**
+ * RX buffer as passed to the XDP program, the metadata kfuncs cast the xdp_md back to it.
+ * In AF_XDP mode the private part lives in the cb of struct xdp_buff_xsk.
+ */
+struct nfb_xdp_buff {
+	struct xdp_buff xdp; // Must be first
+	void *meta; // NDP packet header with firmware metadata, precedes the frame data
+	u8 meta_len;
+};
 
 enum xdp_ctrl_type {
 	NFB_XCTRL_RX,
@@ -66,6 +79,8 @@ struct xctrl {
 				struct {
 					struct xdp_buff **xdp_ring;
 					struct page_pool *pool;
+					u32 frag_size; // Size of one buffer in the page, PAGE_SIZE when not fragmented
+					u32 buf_len; // Max frame data in one buffer
 				} pp;
 				// for xsk operation
 				struct {
@@ -117,6 +132,9 @@ struct xctrl {
 	struct nc_ndp_ctrl c; // underlying controller
 	struct device *dma_dev; // device used for dma allocation
 
+	// counters of the queue owning this ctrl
+	struct nfb_xdp_queue_stats *stats;
+
 	// queue id in context of nfb device
 	u32 nfb_queue_id;
 	// queue id in context of a port
@@ -209,6 +227,10 @@ int nfb_xdp(struct net_device *dev, struct netdev_bpf *xdp);
  */
 int nfb_xsk_wakeup(struct net_device *dev, u32 queue_id, u32 flags);
 
+#ifdef CONFIG_HAVE_XDP_METADATA_OPS
+extern const struct xdp_metadata_ops nfb_xdp_metadata_ops;
+#endif
+
 // Napi poll functions
 int nfb_xctrl_napi_poll_pp(struct napi_struct *napi, int budget);
 int nfb_xctrl_napi_poll_rx_xsk(struct napi_struct *napi, int budget);
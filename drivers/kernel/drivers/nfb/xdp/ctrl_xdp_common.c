@@ -11,6 +11,14 @@
 #include "ctrl_xdp_common.h"
 #include <linux/skbuff.h>
 #include <linux/pci.h>
+#ifdef CONFIG_HAVE_LINUX_UNALIGNED
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
+
+static int xdp_meta_ts_offset = -1;
+static int xdp_meta_hash_offset = -1;
 
 int nfb_xctrl_start(struct xctrl *ctrl)
 {
@@ -69,6 +77,7 @@ netdev_tx_t nfb_xctrl_start_xmit(struct sk_buff *skb, struct net_device *netdev)
 		free_desc = (ctrl->c.hdp - sdp - 1) & mdp;
 		if(free_desc < (nr_frags + 1) * 2) {
 			printk(KERN_WARNING "nfb: %s TX busy warning, packet dropped\n", __func__);
+			nfb_xdp_stats_inc_busy(&txq->stats);
 			goto free_locked;
 		}
 
@@ -140,6 +149,7 @@ netdev_tx_t nfb_xctrl_start_xmit(struct sk_buff *skb, struct net_device *netdev)
 
 		// Update counters
 		ctrl->c.sdp = sdp;
+		nfb_xdp_stats_add(&txq->stats, 1, skb->len);
 
 		// Only flush when finnished
 		if(!netdev_xmit_more()) {
@@ -182,7 +192,7 @@ int nfb_xctrl_xdp_xmit(struct net_device *dev, int n, struct xdp_frame **xdp, u3
 
 	// There doesn't seem to be a good way to decide which queue to use for tx other than semi random
 	// NOTE: If the interrupts are implemented use the affinity logic. 
-	qid = smp_processor_id() % ethdev->channel_count;
+	qid = smp_processor_id() % ethdev->channel_active;
 	channel = &ethdev->channels[qid];
 	txq = &channel->txq;
 	ctrl = txq->ctrl;
@@ -361,3 +371,59 @@ int nfb_xsk_wakeup(struct net_device *dev, u32 queue_id, u32 flags)
 
 	return 0;
 }
+
+#ifdef CONFIG_HAVE_XDP_METADATA_OPS
+/**
+ * @brief Gets a field of the NDP packet header, the layout depends on the firmware
+ *
+ * @param ctx
+ * @param offset byte offset of the field in the header, negative when disabled
+ * @param size size of the field
+ * @return pointer to the field, NULL when the header doesn't contain it
+ */
+static inline const u8 *nfb_xdp_meta_field(const struct xdp_md *ctx, int offset, unsigned size)
+{
+	const struct nfb_xdp_buff *nxdp = (const struct nfb_xdp_buff *)ctx;
+
+	XSK_CHECK_PRIV_TYPE(struct nfb_xdp_buff);
+
+	if (offset < 0 || offset + size > nxdp->meta_len)
+		return NULL;
+	return (const u8 *)nxdp->meta + offset;
+}
+
+static int nfb_xdp_rx_timestamp(const struct xdp_md *ctx, u64 *timestamp)
+{
+	const u8 *ts = nfb_xdp_meta_field(ctx, xdp_meta_ts_offset, sizeof(u64));
+
+	if (!ts)
+		return -ENODATA;
+
+	// Nanoseconds in the lower and seconds in the upper word, same as ndptool header timestamp
+	*timestamp = (u64)get_unaligned_le32(ts + 4) * NSEC_PER_SEC + get_unaligned_le32(ts);
+	return 0;
+}
+
+static int nfb_xdp_rx_hash(const struct xdp_md *ctx, u32 *hash, enum xdp_rss_hash_type *rss_type)
+{
+	const u8 *h = nfb_xdp_meta_field(ctx, xdp_meta_hash_offset, sizeof(u32));
+
+	if (!h)
+		return -ENODATA;
+
+	*hash = get_unaligned_le32(h);
+	// The header doesn't say which fields were hashed
+	*rss_type = XDP_RSS_TYPE_NONE;
+	return 0;
+}
+
+const struct xdp_metadata_ops nfb_xdp_metadata_ops = {
+	.xmo_rx_timestamp = nfb_xdp_rx_timestamp,
+	.xmo_rx_hash = nfb_xdp_rx_hash,
+};
+#endif
+
+module_param(xdp_meta_ts_offset, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(xdp_meta_ts_offset, "Byte offset of the 64-bit timestamp in the NDP packet header for the XDP metadata kfunc, nanoseconds in the lower and seconds in the upper 32 bits [-1 = disabled]");
+module_param(xdp_meta_hash_offset, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(xdp_meta_hash_offset, "Byte offset of the 32-bit RSS hash in the NDP packet header for the XDP metadata kfunc [-1 = disabled]");
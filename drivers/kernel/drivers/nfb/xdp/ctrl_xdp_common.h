@@ -21,6 +21,56 @@
 #include <net/page_pool.h>
 #endif
 
+/**
+ * @brief Gets the DMA address of page_pool memory, the page can be split into fragments
+ *
+ * @param va virtual address inside the page_pool page
+ * @return dma_addr_t
+ */
+static inline dma_addr_t nfb_xctrl_pp_dma_addr(void *va)
+{
+	struct page *page = virt_to_head_page(va);
+	return page_pool_get_dma_addr(page) + (va - page_address(page));
+}
+
+/**
+ * @brief Moves the data start past the NDP packet header and keeps the header for metadata kfuncs
+ *
+ * @param xdp head buffer of the packet with data_end already set
+ * @param meta_len length of the NDP packet header
+ */
+static inline void nfb_xctrl_rx_strip_meta(struct xdp_buff *xdp, u8 meta_len)
+{
+#ifdef CONFIG_HAVE_XDP_METADATA_OPS
+	struct nfb_xdp_buff *nxdp = (struct nfb_xdp_buff *)xdp;
+
+	nxdp->meta = xdp->data;
+	nxdp->meta_len = meta_len;
+#endif
+	xdp->data += meta_len;
+}
+
+/**
+ * @brief Adds the results of one rx burst to the queue counters
+ *
+ * @param stats
+ * @param acts number of packets for each XDP action, unknown actions count as XDP_ABORTED
+ * @param packets
+ * @param bytes
+ */
+static inline void nfb_xctrl_rx_stats_update(struct nfb_xdp_queue_stats *stats, const u32 *acts, u32 packets, u32 bytes)
+{
+	u64_stats_update_begin(&stats->syncp);
+	stats->packets += packets;
+	stats->bytes += bytes;
+	stats->xdp_aborted += acts[XDP_ABORTED];
+	stats->xdp_drop += acts[XDP_DROP];
+	stats->xdp_pass += acts[XDP_PASS];
+	stats->xdp_tx += acts[XDP_TX];
+	stats->xdp_redirect += acts[XDP_REDIRECT];
+	u64_stats_update_end(&stats->syncp);
+}
+
 // TODO: to make the logic easier this could be split into pp and xsk version of the function
 /**
  * @brief Reclaims buffers from tx
@@ -101,6 +151,7 @@ static inline int nfb_xctrl_tx_submit_frame_needs_lock(struct xctrl *ctrl, struc
 	int ret = 0;
 
 	skb_frag_t *frag;
+	u32 bytes = frame->len;
 	
 	u32 nr_frags = xdp_get_shared_info_from_frame(frame)->nr_frags;
 	u32 i, j;
@@ -115,6 +166,7 @@ static inline int nfb_xctrl_tx_submit_frame_needs_lock(struct xctrl *ctrl, struc
 	free_desc = (ctrl->c.hdp - sdp - 1) & mdp;
 	if(free_desc < (nr_frags + 1) * 2) {
 		printk(KERN_WARNING "nfb: submit_frame TX busy warning, packet dropped\n");
+		nfb_xdp_stats_inc_busy(ctrl->stats);
 		ret = -EBUSY;
 		goto exit;
 	}
@@ -143,7 +195,9 @@ static inline int nfb_xctrl_tx_submit_frame_needs_lock(struct xctrl *ctrl, struc
 			goto exit;
 		}
 	} else {
-		dma = page_pool_get_dma_addr(virt_to_page(frame->data)) + XDP_PACKET_HEADROOM;
+		// XDP_TX of the rx page, the program could have written the data
+		dma = nfb_xctrl_pp_dma_addr(frame->data);
+		dma_sync_single_for_device(ctrl->dma_dev, dma, len, DMA_BIDIRECTIONAL);
 	}
 
 	last_upper_addr = ctrl->c.last_upper_addr;
@@ -180,6 +234,7 @@ static inline int nfb_xctrl_tx_submit_frame_needs_lock(struct xctrl *ctrl, struc
 	for(i = 0; i < nr_frags; ++i) {
 		frag = &xdp_get_shared_info_from_frame(frame)->frags[i];
 		len = skb_frag_size(frag);
+		bytes += len;
 
 		// If page_pool, then the page is already mapped
 		if (!pp) {
@@ -194,6 +249,7 @@ static inline int nfb_xctrl_tx_submit_frame_needs_lock(struct xctrl *ctrl, struc
 			}
 		} else {
 			dma = page_pool_get_dma_addr(skb_frag_page(frag)) + skb_frag_off(frag);
+			dma_sync_single_for_device(ctrl->dma_dev, dma, len, DMA_BIDIRECTIONAL);
 		}
 
 		last_upper_addr = ctrl->c.last_upper_addr;
@@ -225,6 +281,7 @@ static inline int nfb_xctrl_tx_submit_frame_needs_lock(struct xctrl *ctrl, struc
 
 	// Update ctrl state
 	ctrl->c.sdp = sdp;
+	nfb_xdp_stats_add(ctrl->stats, 1, bytes);
 exit:
 	return ret;
 
@@ -16,6 +16,8 @@
 
 #include "ctrl_xdp_common.h"
 
+static unsigned int xdp_rx_pp_frags = 1;
+
 /**
  * @brief Tries to rexmit pp page. Frees page on fail via xdp_return_buff (gets the page_pool from mem info)
  * 
@@ -65,7 +67,11 @@ static inline int nfb_xctrl_rx_fill_pp(struct xctrl *ctrl)
 	u32 fbp = ctrl->rx.fbp;
 
 	struct page_pool *pool = ctrl->rx.pp.pool;
+	const u32 frag_size = ctrl->rx.pp.frag_size;
+	const u32 buf_len = ctrl->rx.pp.buf_len;
 	struct page *page;
+	unsigned int offset = 0;
+	void *va;
 	dma_addr_t dma;
 	struct nc_ndp_desc *descs = ctrl->desc_buffer_virt;
 	u32 free_desc, free_buffs;
@@ -80,11 +86,19 @@ static inline int nfb_xctrl_rx_fill_pp(struct xctrl *ctrl)
 
 	// Alloc buffers and send them to card
 	for (filled = 0; filled < batch_size; filled++) {
-		if (!(page = page_pool_dev_alloc_pages(pool))) {
+#ifdef CONFIG_HAVE_PAGE_POOL_DEV_ALLOC_FRAG
+		if (frag_size < PAGE_SIZE)
+			page = page_pool_dev_alloc_frag(pool, &offset, frag_size);
+		else
+#endif
+			page = page_pool_dev_alloc_pages(pool);
+		if (!page) {
 			printk(KERN_WARNING "nfb: failed to allocate page from page pool\n");
+			nfb_xdp_stats_inc_alloc_fail(ctrl->stats);
 			break;
 		}
-		dma = page_pool_get_dma_addr(page) + XDP_PACKET_HEADROOM;
+		va = page_address(page) + offset;
+		dma = page_pool_get_dma_addr(page) + offset + XDP_PACKET_HEADROOM;
 		if (unlikely(NDP_CTRL_DESC_UPPER_ADDR(dma) != last_upper_addr)) {
 			if (unlikely(free_desc == 0)) {
 				page_pool_put_full_page(pool, page, true);
@@ -102,14 +116,14 @@ static inline int nfb_xctrl_rx_fill_pp(struct xctrl *ctrl)
 		}
 
 		// Init the buffer
-		xdp_init_buff(ctrl->rx.pp.xdp_ring[fbp], PAGE_SIZE, &ctrl->rx.rxq_info);
-		xdp_prepare_buff(ctrl->rx.pp.xdp_ring[fbp], page_to_virt(page), XDP_PACKET_HEADROOM, 0, false);
+		xdp_init_buff(ctrl->rx.pp.xdp_ring[fbp], frag_size, &ctrl->rx.rxq_info);
+		xdp_prepare_buff(ctrl->rx.pp.xdp_ring[fbp], va, XDP_PACKET_HEADROOM, 0, false);
 		xdp_get_shared_info_from_buff(ctrl->rx.pp.xdp_ring[fbp])->nr_frags = 0;
 #ifdef CONFIG_HAVE_XDP_SG
 		xdp_buff_clear_frags_flag(ctrl->rx.pp.xdp_ring[fbp]);
-		descs[sdp] = nc_ndp_rx_desc2(dma, NFB_PP_MAX_FRAME_LEN, 1);
+		descs[sdp] = nc_ndp_rx_desc2(dma, buf_len, 1);
 #else
-		descs[sdp] = nc_ndp_rx_desc2(dma, NFB_PP_MAX_FRAME_LEN, 0);
+		descs[sdp] = nc_ndp_rx_desc2(dma, buf_len, 0);
 #endif
 		sdp = (sdp + 1) & mdp;
 		fbp = (fbp + 1) & mbp;
@@ -128,9 +142,10 @@ static inline int nfb_xctrl_rx_fill_pp(struct xctrl *ctrl)
  * @param prog 
  * @param xdp 
  * @param rxq 
- * @return result
+ * @param sync_len length of the head buffer synced for cpu
+ * @return the XDP action taken
  */
-static inline void nfb_xctrl_handle_pp(struct bpf_prog *prog, struct xdp_buff *xdp, struct nfb_xdp_queue *rxq, struct napi_struct *napi)
+static inline unsigned nfb_xctrl_handle_pp(struct bpf_prog *prog, struct xdp_buff *xdp, struct nfb_xdp_queue *rxq, struct napi_struct *napi, u32 sync_len)
 {
 	unsigned act;
 	int ret;
@@ -187,9 +202,20 @@ static inline void nfb_xctrl_handle_pp(struct bpf_prog *prog, struct xdp_buff *x
 		fallthrough;
 	case XDP_ABORTED:
 aborted:
+		act = XDP_ABORTED;
 		printk(KERN_ERR "nfb: %s packet aborted\n", __func__);
 		fallthrough;
 	case XDP_DROP:
+#ifdef CONFIG_HAVE_XDP_SG
+		if (!xdp_buff_has_frags(xdp) && rxq->ctrl->rx.pp.frag_size == PAGE_SIZE) {
+#else
+		if (rxq->ctrl->rx.pp.frag_size == PAGE_SIZE) {
+#endif
+			// Recycle directly, syncing for device only the part the cpu could have touched
+			sync_len = max_t(u32, xdp->data_end - xdp->data_hard_start - XDP_PACKET_HEADROOM, sync_len);
+			page_pool_put_page(rxq->ctrl->rx.pp.pool, virt_to_head_page(xdp->data), sync_len, true);
+			break;
+		}
 		// TODO: add this into autoconf
 		// xdp_return_buff definition is missing in 4.18.0-477.10.1.el8_8.x86_64
 		// xdp_return_buff(xdp);
@@ -197,6 +223,7 @@ aborted:
 		break;
 	}
 	rcu_read_unlock();
+	return act;
 }
 
 static inline u16 nfb_xctrl_rx_pp(struct xctrl *ctrl, u16 nb_pkts, struct nfb_ethdev *ethdev, struct nfb_xdp_queue *rxq, struct napi_struct *napi)
@@ -210,11 +237,17 @@ static inline u16 nfb_xctrl_rx_pp(struct xctrl *ctrl, u16 nb_pkts, struct nfb_et
 	const u32 mhp = ctrl->c.mhp;
 	u32 pbp = ctrl->rx.pbp;
 	const u32 mbp = ctrl->rx.mbp;
+	const u32 buf_len = ctrl->rx.pp.buf_len;
+	u32 head_len;
+	u32 acts[XDP_REDIRECT + 1] = {0};
+	u32 bytes = 0;
 
 	struct xdp_buff *head;
 #ifdef CONFIG_HAVE_XDP_SG
 	struct xdp_buff *frag;
 	struct skb_shared_info *sinfo;
+	struct page *page;
+	u32 frag_len;
 #endif
 
 	// Fill the card with empty buffers
@@ -238,15 +271,17 @@ static inline u16 nfb_xctrl_rx_pp(struct xctrl *ctrl, u16 nb_pkts, struct nfb_et
 		// Get the first fragment (head)
 		head = ctrl->rx.pp.xdp_ring[pbp];
 		pbp = (pbp + 1) & mbp;
-		dma_sync_single_for_cpu(ctrl->dma_dev, page_pool_get_dma_addr(virt_to_page(head->data_hard_start)), PAGE_SIZE, DMA_BIDIRECTIONAL);
+		// Sync only the received part of the buffer
+		head_len = min(len_remain, buf_len);
+		dma_sync_single_for_cpu(ctrl->dma_dev, nfb_xctrl_pp_dma_addr(head->data), head_len, DMA_BIDIRECTIONAL);
 
 		// Process head
 #ifndef CONFIG_HAVE_XDP_SG
 		if (false) {
 #else
-		if (len_remain > NFB_PP_MAX_FRAME_LEN) { // Is fragmented
-			head->data_end = head->data + NFB_PP_MAX_FRAME_LEN;
-			len_remain -= NFB_PP_MAX_FRAME_LEN;
+		if (len_remain > buf_len) { // Is fragmented
+			head->data_end = head->data + buf_len;
+			len_remain -= buf_len;
 			xdp_buff_set_frags_flag(head);
 			sinfo = xdp_get_shared_info_from_buff(head);
 			sinfo->xdp_frags_size = len_remain;
@@ -261,19 +296,20 @@ static inline u16 nfb_xctrl_rx_pp(struct xctrl *ctrl, u16 nb_pkts, struct nfb_et
 		while (len_remain) {
 			frag = ctrl->rx.pp.xdp_ring[pbp];
 			pbp = (pbp + 1) & mbp;
-			dma_sync_single_for_cpu(ctrl->dma_dev, page_pool_get_dma_addr(virt_to_page(frag->data_hard_start)), PAGE_SIZE, DMA_BIDIRECTIONAL);
-			if (len_remain > NFB_PP_MAX_FRAME_LEN) { // Not last fragment
-				skb_frag_fill_page_desc(&sinfo->frags[sinfo->nr_frags++], virt_to_page(frag->data_hard_start), XDP_PACKET_HEADROOM, NFB_PP_MAX_FRAME_LEN);
-				len_remain -= NFB_PP_MAX_FRAME_LEN;
-			} else { // Last fragment
-				skb_frag_fill_page_desc(&sinfo->frags[sinfo->nr_frags++], virt_to_page(frag->data_hard_start), XDP_PACKET_HEADROOM, len_remain);
-				len_remain -= len_remain;
-			}
+			// Not last fragment takes the whole buffer
+			frag_len = min(len_remain, buf_len);
+			dma_sync_single_for_cpu(ctrl->dma_dev, nfb_xctrl_pp_dma_addr(frag->data), frag_len, DMA_BIDIRECTIONAL);
+			page = virt_to_head_page(frag->data);
+			skb_frag_fill_page_desc(&sinfo->frags[sinfo->nr_frags++], page, frag->data - page_address(page), frag_len);
+			len_remain -= frag_len;
 		}
 #endif
 
-		nfb_xctrl_handle_pp(ethdev->prog, head, rxq, napi);
+		nfb_xctrl_rx_strip_meta(head, hdr->hdr_len);
+		bytes += hdr->frame_len - hdr->hdr_len;
+		acts[nfb_xctrl_handle_pp(ethdev->prog, head, rxq, napi, head_len)]++;
 	}
+	nfb_xctrl_rx_stats_update(&rxq->stats, acts, nb_rx, bytes);
 
 	// Update ctrl state
 	ctrl->c.shp = shp;
@@ -311,7 +347,8 @@ int nfb_xctrl_napi_poll_pp(struct napi_struct *napi, int budget)
 		return budget;
 
 	// Work done -> finish
-	napi_complete_done(napi, received);
+	if (napi_complete_done(napi, received))
+		channel_napi_rearm(rxq, received);
 	return received;
 }
 
@@ -368,14 +405,16 @@ struct xctrl *nfb_xctrl_alloc_pp(struct net_device *netdev, u32 queue_id, u32 de
 	struct xctrl *ctrl;
 	int fdt_offset;
 	u32 i;
-	struct xdp_buff *buffs;
+	struct nfb_xdp_buff *buffs;
+	u32 frags = 1;
 
+	// Page pool syncs for device only the area where the card writes frames
 	struct page_pool_params ppp = {
 		.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV,
 		.dev = &nfb->pci->dev,
 		.dma_dir = DMA_BIDIRECTIONAL,
-		.max_len = PAGE_SIZE,
-		.offset = 0,
+		.max_len = NFB_PP_MAX_FRAME_LEN,
+		.offset = XDP_PACKET_HEADROOM,
 		.order = 0,
 		.pool_size = desc_cnt,
 	};
@@ -403,6 +442,21 @@ struct xctrl *nfb_xctrl_alloc_pp(struct net_device *netdev, u32 queue_id, u32 de
 
 	ppp.nid = channel->numa;
 
+#if defined(CONFIG_HAVE_PAGE_POOL_DEV_ALLOC_FRAG) && defined(CONFIG_HAVE_XDP_SG)
+	// Frames bigger than the fragment are received as multi-buffer
+	if (type == NFB_XCTRL_RX)
+		frags = clamp(xdp_rx_pp_frags, 1u, (u32)(PAGE_SIZE / NFB_PP_FRAG_SIZE_MIN));
+#endif
+	if (frags > 1) {
+		// The whole page is synced when the last fragment returns
+		ppp.max_len = PAGE_SIZE;
+		ppp.offset = 0;
+		ppp.pool_size = DIV_ROUND_UP(desc_cnt, frags);
+#ifdef CONFIG_HAVE_PP_FLAG_PAGE_FRAG
+		ppp.flags |= PP_FLAG_PAGE_FRAG;
+#endif
+	}
+
 	// Allocating struct
 	if (!(ctrl = kzalloc_node(sizeof(struct xctrl), GFP_KERNEL, channel->numa))) {
 		err = -ENOMEM;
@@ -410,10 +464,15 @@ struct xctrl *nfb_xctrl_alloc_pp(struct net_device *netdev, u32 queue_id, u32 de
 	}
 
 	ctrl->type = type;
+	ctrl->stats = &queue->stats;
 	ctrl->nfb_queue_id = channel->nfb_index;
 	ctrl->netdev_queue_id = channel->index;
 	ctrl->dma_dev = &nfb->pci->dev;
 	ctrl->nb_desc = desc_cnt;
+	if (type == NFB_XCTRL_RX) {
+		ctrl->rx.pp.frag_size = frags > 1 ? ALIGN_DOWN(PAGE_SIZE / frags, SMP_CACHE_BYTES) : PAGE_SIZE;
+		ctrl->rx.pp.buf_len = NFB_PP_FRAME_LEN(ctrl->rx.pp.frag_size);
+	}
 
 	// Allocating control buffers
 	switch (type) {
@@ -423,7 +482,7 @@ struct xctrl *nfb_xctrl_alloc_pp(struct net_device *netdev, u32 queue_id, u32 de
 			goto buff_alloc_fail;
 		}
 		ctrl->rx.mbp = ctrl->nb_desc - 1;
-		if (!(buffs = kzalloc_node(sizeof(struct xdp_buff) * desc_cnt, GFP_KERNEL, channel->numa))) {
+		if (!(buffs = kzalloc_node(sizeof(struct nfb_xdp_buff) * desc_cnt, GFP_KERNEL, channel->numa))) {
 			err = -ENOMEM;
 			goto buffs_alloc_fail;
 		}
@@ -466,7 +525,13 @@ struct xctrl *nfb_xctrl_alloc_pp(struct net_device *netdev, u32 queue_id, u32 de
 			err = -ENOMEM;
 			goto pp_alloc_fail;
 		}
-		if ((err = xdp_rxq_info_reg(&ctrl->rx.rxq_info, netdev, channel->index, 0))) {
+#ifdef CONFIG_HAVE_XDP_SG
+		// Multi-buffer frames: bpf_xdp_adjust_tail grows the last fragment up to frag_size
+		err = __xdp_rxq_info_reg(&ctrl->rx.rxq_info, netdev, channel->index, 0, ctrl->rx.pp.frag_size);
+#else
+		err = xdp_rxq_info_reg(&ctrl->rx.rxq_info, netdev, channel->index, 0);
+#endif
+		if (err) {
 			printk(KERN_ERR "nfb: rx_info register fail with: %d\n", err);
 			goto meminfo_reg_fail;
 		}
@@ -476,7 +541,7 @@ struct xctrl *nfb_xctrl_alloc_pp(struct net_device *netdev, u32 queue_id, u32 de
 		}
 
 		for (i = 0; i < desc_cnt; i++) {
-			ctrl->rx.pp.xdp_ring[i] = &buffs[i];
+			ctrl->rx.pp.xdp_ring[i] = &buffs[i].xdp;
 		}
 	}
 
@@ -558,3 +623,6 @@ void nfb_xctrl_destroy_pp(struct xctrl *ctrl)
 	kfree(ctrl);
 	ctrl = NULL;
 }
+
+module_param(xdp_rx_pp_frags, uint, S_IRUGO);
+MODULE_PARM_DESC(xdp_rx_pp_frags, "Number of RX buffers packed into one page in page pool mode, bigger frames span multiple buffers [1]");
@@ -30,6 +30,7 @@ static inline int nfb_xctrl_rexmit_xsk(struct xctrl *ctrl, struct xsk_buff_pool
 	u32 sdp;
 	u32 mdp;
 	u32 n_frags, i;
+	u32 bytes = 0;
 
 	struct nc_ndp_desc *descs = ctrl->desc_buffer_virt;
 	struct xdp_buff *frags[NFB_MAX_AF_XDP_FRAGS];
@@ -61,6 +62,7 @@ static inline int nfb_xctrl_rexmit_xsk(struct xctrl *ctrl, struct xsk_buff_pool
 		// One to update the addr and second with data
 		if(free_desc < n_frags * 2) {
 			printk(KERN_ERR "nfb: XDP_TX busy warning, packet dropped\n");
+			nfb_xdp_stats_inc_busy(ctrl->stats);
 			for (i = 0; i < n_frags; i++)
 				xsk_buff_free(frags[i]);
 
@@ -86,6 +88,7 @@ static inline int nfb_xctrl_rexmit_xsk(struct xctrl *ctrl, struct xsk_buff_pool
 			ctrl->tx.buffers[sdp].xsk = frags[i];
 			ctrl->tx.buffers[sdp].dma = dma;
 			ctrl->tx.buffers[sdp].len = len;
+			bytes += len;
 			if(i == n_frags - 1) { // Last part of the packet
 				descs[sdp] = nc_ndp_tx_desc2(dma, len, 0, 0);
 			} else { // Another fragment incomming
@@ -97,6 +100,7 @@ static inline int nfb_xctrl_rexmit_xsk(struct xctrl *ctrl, struct xsk_buff_pool
 
 		// Update ctrl
 		ctrl->c.sdp = sdp;
+		nfb_xdp_stats_add(ctrl->stats, 1, bytes);
 	}
 out:
 	spin_unlock(&ctrl->tx.tx_lock);
@@ -158,6 +162,8 @@ static inline int nfb_xctrl_rx_fill_xsk(struct xctrl *ctrl)
 	// Internaly calculates with XDP_PACKET_HEADROOM, shared info is not used
 	frame_len = xsk_pool_get_rx_frame_size(pool);
 	real_count = xsk_buff_alloc_batch(pool, buffs, batch_size);
+	if (unlikely(real_count < batch_size))
+		nfb_xdp_stats_inc_alloc_fail(ctrl->stats);
 	for (filled = 0; filled < real_count; filled++) {
 		dma = xsk_buff_xdp_get_dma(buffs[filled]); // Takes XDP_PACKET_HEADROOM into account
 		if (unlikely(NDP_CTRL_DESC_UPPER_ADDR(dma) != last_upper_addr)) {
@@ -233,9 +239,9 @@ out:
  * @param prog 
  * @param xdp 
  * @param rxq 
- * @return result
+ * @return the XDP action taken
  */
-static inline void nfb_xctrl_handle_xsk(struct bpf_prog *prog, struct xdp_buff *xdp, struct nfb_xdp_queue *rxq)
+static inline unsigned nfb_xctrl_handle_xsk(struct bpf_prog *prog, struct xdp_buff *xdp, struct nfb_xdp_queue *rxq)
 {
 	unsigned act;
 	int ret;
@@ -308,6 +314,7 @@ static inline void nfb_xctrl_handle_xsk(struct bpf_prog *prog, struct xdp_buff *
 		fallthrough;
 	case XDP_ABORTED:
 aborted:
+		act = XDP_ABORTED;
 		printk(KERN_ERR "nfb: %s packet aborted\n", __func__);
 		fallthrough;
 	case XDP_DROP:
@@ -315,6 +322,7 @@ aborted:
 		break;
 	}
 	rcu_read_unlock();
+	return act;
 }
 
 #ifndef CONFIG_HAVE_XSK_BUFF_SET_SIZE
@@ -337,6 +345,8 @@ static inline u16 nfb_xctrl_rx_xsk(struct xctrl *ctrl, u16 nb_pkts, struct nfb_e
 	const u32 mhp = ctrl->c.mhp;
 	u32 pbp = ctrl->rx.pbp;
 	const u32 mbp = ctrl->rx.mbp;
+	u32 acts[XDP_REDIRECT + 1] = {0};
+	u32 bytes = 0;
 
 	struct xdp_buff *head;
 #ifdef CONFIG_HAVE_AF_XDP_SG
@@ -417,8 +427,11 @@ static inline u16 nfb_xctrl_rx_xsk(struct xctrl *ctrl, u16 nb_pkts, struct nfb_e
 		}
 #endif // CONFIG_HAVE_AF_XDP_SG
 
-		nfb_xctrl_handle_xsk(ethdev->prog, head, rxq);
+		nfb_xctrl_rx_strip_meta(head, hdr->hdr_len);
+		bytes += hdr->frame_len - hdr->hdr_len;
+		acts[nfb_xctrl_handle_xsk(ethdev->prog, head, rxq)]++;
 	}
+	nfb_xctrl_rx_stats_update(&rxq->stats, acts, nb_rx, bytes);
 
 	// update ctrl state
 	ctrl->c.shp = shp;
@@ -464,7 +477,8 @@ int nfb_xctrl_napi_poll_rx_xsk(struct napi_struct *napi, int budget)
 		return budget;
 
 	// Work done -> finish
-	napi_complete_done(napi, received);
+	if (napi_complete_done(napi, received))
+		channel_napi_rearm(rxq, received);
 	return received;
 }
 
@@ -480,6 +494,8 @@ int nfb_xctrl_napi_poll_tx_xsk(struct napi_struct *napi, int budget)
 	dma_addr_t dma;
 	void *data;
 	u32 len;
+	u32 bytes = 0;
+	u32 packets = 0;
 
 	u64 last_upper_addr;
 	u32 sdp;
@@ -509,6 +525,7 @@ int nfb_xctrl_napi_poll_tx_xsk(struct napi_struct *napi, int budget)
 			data = xsk_buff_raw_get_data(pool, buffs[i].addr);
 			dma = xsk_buff_raw_get_dma(pool, buffs[i].addr);
 			len = buffs[i].len;
+			bytes += len;
 
 			if (len < ETH_ZLEN) { // Packet is too small
 				memset(data + len, 0, ETH_ZLEN - len);
@@ -531,6 +548,7 @@ int nfb_xctrl_napi_poll_tx_xsk(struct napi_struct *napi, int budget)
 			if(xsk_is_eop_desc(&buffs[i])) { // Last part of the packet
 #endif
 				descs[sdp] = nc_ndp_tx_desc2(dma, len, 0, 0);
+				packets++;
 			} else { // Another fragment incomming
 				descs[sdp] = nc_ndp_tx_desc2(dma, len, 0, 1);
 			}
@@ -539,6 +557,8 @@ int nfb_xctrl_napi_poll_tx_xsk(struct napi_struct *napi, int budget)
 		}
 		// Update ctrl
 		ctrl->c.sdp = sdp;
+		// Fragments of a multi-buffer frame count as one packet
+		nfb_xdp_stats_add(ctrl->stats, packets, bytes);
 out:
 		// Flush counters when done (Maybe frames were enqueued by XDP_TX)
 		nc_ndp_ctrl_sdp_flush(&ctrl->c);
@@ -550,7 +570,8 @@ out:
 		return budget;
 
 	// Work done -> finish
-	napi_complete_done(napi, i);
+	if (napi_complete_done(napi, i))
+		channel_napi_rearm(txq, i);
 	return i;
 }
 
@@ -624,6 +645,7 @@ struct xctrl *nfb_xctrl_alloc_xsk(struct net_device *netdev, u32 queue_id, struc
 	}
 
 	ctrl->type = type;
+	ctrl->stats = &queue->stats;
 	ctrl->nfb_queue_id = channel->nfb_index;
 	ctrl->netdev_queue_id = channel->index;
 	ctrl->dma_dev = &nfb->pci->dev;
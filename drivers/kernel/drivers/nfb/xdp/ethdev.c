@@ -41,6 +41,8 @@ static int nfb_xdp_channels_init(struct net_device *netdev, unsigned *channel_in
 		for (ch_idx = 0; ch_idx < channel_count; ch_idx++) {
 			if(nfb_idx == channel_indexes[ch_idx]) {
 				mutex_init(&ethdev->channels[map_idx].state_mutex);
+				u64_stats_init(&ethdev->channels[map_idx].rxq.stats.syncp);
+				u64_stats_init(&ethdev->channels[map_idx].txq.stats.syncp);
 				ethdev->channels[map_idx].ethdev = ethdev;
 				ethdev->channels[map_idx].index = map_idx;
 				ethdev->channels[map_idx].nfb_index = nfb_idx;
@@ -131,7 +133,7 @@ static int nfb_start_channels(struct net_device *netdev)
 	netdev->features |= NETIF_F_SG;
 
 	// Threads take care of setting up and tearing down the queues as XDP demands the abillity to do that on the fly
-	for (i = 0; i < ethdev->channel_count; i++) {
+	for (i = 0; i < ethdev->channel_active; i++) {
 		channel = &ethdev->channels[i];
 		if ((ret = channel_start_pp(channel))) {
 			printk(KERN_ERR "nfb: failed to start channels\n");
@@ -157,11 +159,30 @@ static int nfb_xdp_stop(struct net_device *netdev)
 	return 0;
 }
 
+static void nfb_xdp_get_stats64(struct net_device *netdev, struct rtnl_link_stats64 *stats)
+{
+	struct nfb_ethdev *ethdev = netdev_priv(netdev);
+	struct nfb_xdp_queue_stats qstats;
+	int i;
+
+	for (i = 0; i < ethdev->channel_count; i++) {
+		nfb_xdp_queue_stats_read(&ethdev->channels[i].rxq.stats, &qstats);
+		stats->rx_packets += qstats.packets;
+		stats->rx_bytes += qstats.bytes;
+		stats->rx_dropped += qstats.xdp_aborted;
+
+		nfb_xdp_queue_stats_read(&ethdev->channels[i].txq.stats, &qstats);
+		stats->tx_packets += qstats.packets;
+		stats->tx_bytes += qstats.bytes;
+		stats->tx_dropped += qstats.busy;
+	}
+}
+
 static const struct net_device_ops netdev_ops = {
 	.ndo_open = nfb_xdp_open,
 	.ndo_stop = nfb_xdp_stop,
 	.ndo_start_xmit = nfb_xctrl_start_xmit,
-	// .ndo_get_stats64 = nfb_xdp_get_stats,
+	.ndo_get_stats64 = nfb_xdp_get_stats64,
 	.ndo_bpf = nfb_xdp,
 	.ndo_xdp_xmit = nfb_xctrl_xdp_xmit,
 	.ndo_xsk_wakeup = nfb_xsk_wakeup,
@@ -293,9 +314,12 @@ int create_ethdev(struct nfb_xdp *module, u16 index, unsigned * channel_indexes,
 		ethdev = netdev_priv(netdev);
 		ethdev->index = index;
 		ethdev->channel_count = channel_count;
+		ethdev->channel_active = channel_count;
 		ethdev->module = module;
 		ethdev->nfb = nfb;
 		ethdev->netdev = netdev;
+		ethdev->kick_usecs_min = NFB_XDP_KICK_USECS_MIN;
+		ethdev->kick_usecs_max = NFB_XDP_KICK_USECS_MAX;
 
 		// Initialize channels
 		if ((ret = nfb_xdp_channels_init(netdev, channel_indexes, channel_count))) {
@@ -349,6 +373,10 @@ int create_ethdev(struct nfb_xdp *module, u16 index, unsigned * channel_indexes,
 		INIT_WORK(&ethdev->link_work, link_work_handler);
 		timer_setup(&ethdev->link_timer, link_timer_callback, 0);
 		netdev->netdev_ops = &netdev_ops;
+		nfb_xdp_set_ethtool_ops(netdev);
+#ifdef CONFIG_HAVE_XDP_METADATA_OPS
+		netdev->xdp_metadata_ops = &nfb_xdp_metadata_ops;
+#endif
 
 		// calls nfb_xdp_open
 		if ((ret = register_netdev(netdev))) {
@@ -24,6 +24,7 @@ struct nfb_ethdev {
 	int index; // index of ETH device
 
 	u16 channel_count;
+	u16 channel_active; // Number of used channels, set by ethtool -L
 	struct nfb_xdp_channel *channels;
 
 	// work setting interface up or down based on the state of the mac
@@ -34,6 +35,10 @@ struct nfb_ethdev {
 	u16 mac_count; // XDP netdevice can span multiple physical interfaces
 	struct nc_rxmac **nc_rxmacs;
 
+	// NAPI kick period bounds in us, set by ethtool coalesce
+	u32 kick_usecs_min;
+	u32 kick_usecs_max;
+
 	// prog is rcu protected pointer
 	struct bpf_prog *prog; // xdp prog
 	spinlock_t prog_lock;
@@ -41,4 +46,9 @@ struct nfb_ethdev {
 
 int create_ethdev(struct nfb_xdp *module, u16 index, unsigned * channel_indexes, unsigned channel_count);
 int destroy_ethdev(struct nfb_xdp *module, int index);
+
+// ethtool.c
+struct nfb_xdp_queue_stats;
+void nfb_xdp_queue_stats_read(struct nfb_xdp_queue_stats *stats, struct nfb_xdp_queue_stats *copy);
+void nfb_xdp_set_ethtool_ops(struct net_device *netdev);
 #endif // NFB_XDP_ETHDEV
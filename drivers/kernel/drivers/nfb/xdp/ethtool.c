@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: BSD-3-Clause OR GPL-2.0 */
+/*
+ * XDP driver of the NFB platform - ethtool support
+ *
+ * Copyright (C) 2017-2025 CESNET
+ * Author(s):
+ *   Richard Hyros <hyros@cesnet.cz>
+ */
+
+#include <linux/netdevice.h>
+#include <linux/ethtool.h>
+
+#include "ctrl_xdp_common.h"
+
+struct nfb_xdp_queue_stat {
+	char stat_string[ETH_GSTRING_LEN];
+	int stat_offset;
+};
+
+#define NFB_XDP_QUEUE_STAT(m) offsetof(struct nfb_xdp_queue_stats, m)
+
+static const struct nfb_xdp_queue_stat nfb_xdp_rx_queue_stats[] = {
+	{"packets",                             NFB_XDP_QUEUE_STAT(packets)},
+	{"bytes",                               NFB_XDP_QUEUE_STAT(bytes)},
+	{"xdp_pass",                            NFB_XDP_QUEUE_STAT(xdp_pass)},
+	{"xdp_drop",                            NFB_XDP_QUEUE_STAT(xdp_drop)},
+	{"xdp_tx",                              NFB_XDP_QUEUE_STAT(xdp_tx)},
+	{"xdp_redirect",                        NFB_XDP_QUEUE_STAT(xdp_redirect)},
+	{"xdp_aborted",                         NFB_XDP_QUEUE_STAT(xdp_aborted)},
+	{"alloc_fail",                          NFB_XDP_QUEUE_STAT(alloc_fail)},
+};
+
+static const struct nfb_xdp_queue_stat nfb_xdp_tx_queue_stats[] = {
+	{"packets",                             NFB_XDP_QUEUE_STAT(packets)},
+	{"bytes",                               NFB_XDP_QUEUE_STAT(bytes)},
+	{"busy",                                NFB_XDP_QUEUE_STAT(busy)},
+};
+
+#define NFB_XDP_RX_QUEUE_STATS_LEN ARRAY_SIZE(nfb_xdp_rx_queue_stats)
+#define NFB_XDP_TX_QUEUE_STATS_LEN ARRAY_SIZE(nfb_xdp_tx_queue_stats)
+
+#if defined(CONFIG_HAVE_PAGE_POOL_ETHTOOL_STATS) && defined(CONFIG_PAGE_POOL_STATS)
+#define NFB_XDP_PP_STATS
+#endif
+
+/**
+ * @brief Reads the queue counters consistently with the writer
+ *
+ * @param stats
+ * @param copy
+ */
+void nfb_xdp_queue_stats_read(struct nfb_xdp_queue_stats *stats, struct nfb_xdp_queue_stats *copy)
+{
+	unsigned start;
+
+	do {
+		start = u64_stats_fetch_begin(&stats->syncp);
+		copy->packets = stats->packets;
+		copy->bytes = stats->bytes;
+		copy->xdp_pass = stats->xdp_pass;
+		copy->xdp_drop = stats->xdp_drop;
+		copy->xdp_tx = stats->xdp_tx;
+		copy->xdp_redirect = stats->xdp_redirect;
+		copy->xdp_aborted = stats->xdp_aborted;
+		copy->alloc_fail = stats->alloc_fail;
+		copy->busy = stats->busy;
+	} while (u64_stats_fetch_retry(&stats->syncp, start));
+}
+
+static void nfb_xdp_get_strings(struct net_device *netdev, u32 stringset, u8 *data)
+{
+	struct nfb_ethdev *ethdev = netdev_priv(netdev);
+	char *p = (char *) data;
+	int i, j;
+
+	switch (stringset) {
+	case ETH_SS_STATS:
+		for (i = 0; i < ethdev->channel_count; i++) {
+			for (j = 0; j < NFB_XDP_RX_QUEUE_STATS_LEN; j++) {
+				snprintf(p, ETH_GSTRING_LEN, "rx%d_%s", i, nfb_xdp_rx_queue_stats[j].stat_string);
+				p += ETH_GSTRING_LEN;
+			}
+			for (j = 0; j < NFB_XDP_TX_QUEUE_STATS_LEN; j++) {
+				snprintf(p, ETH_GSTRING_LEN, "tx%d_%s", i, nfb_xdp_tx_queue_stats[j].stat_string);
+				p += ETH_GSTRING_LEN;
+			}
+		}
+#ifdef NFB_XDP_PP_STATS
+		page_pool_ethtool_stats_get_strings((u8 *) p);
+#endif
+		break;
+	}
+}
+
+static int nfb_xdp_get_sset_count(struct net_device *netdev, int sset)
+{
+	struct nfb_ethdev *ethdev = netdev_priv(netdev);
+	int count;
+
+	switch (sset) {
+	case ETH_SS_STATS:
+		count = ethdev->channel_count * (NFB_XDP_RX_QUEUE_STATS_LEN + NFB_XDP_TX_QUEUE_STATS_LEN);
+#ifdef NFB_XDP_PP_STATS
+		count += page_pool_ethtool_stats_get_count();
+#endif
+		return count;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void nfb_xdp_get_ethtool_stats(struct net_device *netdev, struct ethtool_stats *stats, u64 *data)
+{
+	struct nfb_ethdev *ethdev = netdev_priv(netdev);
+	struct nfb_xdp_channel *channel;
+	struct nfb_xdp_queue_stats qstats;
+	int i, j;
+#ifdef NFB_XDP_PP_STATS
+	struct page_pool_stats pp_stats = {0};
+#endif
+
+	for (i = 0; i < ethdev->channel_count; i++) {
+		channel = &ethdev->channels[i];
+
+		nfb_xdp_queue_stats_read(&channel->rxq.stats, &qstats);
+		for (j = 0; j < NFB_XDP_RX_QUEUE_STATS_LEN; j++)
+			*data++ = *(u64 *)((char *) &qstats + nfb_xdp_rx_queue_stats[j].stat_offset);
+
+		nfb_xdp_queue_stats_read(&channel->txq.stats, &qstats);
+		for (j = 0; j < NFB_XDP_TX_QUEUE_STATS_LEN; j++)
+			*data++ = *(u64 *)((char *) &qstats + nfb_xdp_tx_queue_stats[j].stat_offset);
+
+#ifdef NFB_XDP_PP_STATS
+		// Page pool exists only while the channel runs in the page pool mode
+		mutex_lock(&channel->state_mutex);
+		if (test_bit(NFB_STATUS_IS_RUNNING, &channel->status) && !test_bit(NFB_STATUS_IS_XSK, &channel->status))
+			page_pool_get_stats(channel->rxq.ctrl->rx.pp.pool, &pp_stats);
+		mutex_unlock(&channel->state_mutex);
+#endif
+	}
+
+#ifdef NFB_XDP_PP_STATS
+	page_pool_ethtool_stats_get(data, &pp_stats);
+#endif
+}
+
+static void nfb_xdp_get_channels(struct net_device *netdev, struct ethtool_channels *channels)
+{
+	struct nfb_ethdev *ethdev = netdev_priv(netdev);
+
+	channels->max_combined = ethdev->channel_count;
+	channels->combined_count = ethdev->channel_active;
+}
+
+// The set of DMA channels is given by nfb-dma on creation, only the number of the used ones can change
+static int nfb_xdp_set_channels(struct net_device *netdev, struct ethtool_channels *channels)
+{
+	struct nfb_ethdev *ethdev = netdev_priv(netdev);
+	int ret;
+
+	if (channels->rx_count || channels->tx_count || channels->other_count)
+		return -EINVAL;
+
+	if (channels->combined_count == 0 || channels->combined_count > ethdev->channel_count)
+		return -EINVAL;
+
+	if (netif_running(netdev))
+		return -EBUSY;
+
+	if ((ret = netif_set_real_num_tx_queues(netdev, channels->combined_count)))
+		return ret;
+	if ((ret = netif_set_real_num_rx_queues(netdev, channels->combined_count)))
+		return ret;
+
+	ethdev->channel_active = channels->combined_count;
+	return 0;
+}
+
+#ifdef CONFIG_HAVE_ETHTOOL_KERNEL_COALESCE
+static int nfb_xdp_get_coalesce(struct net_device *netdev, struct ethtool_coalesce *ec,
+		struct kernel_ethtool_coalesce *kec, struct netlink_ext_ack *extack)
+#else
+static int nfb_xdp_get_coalesce(struct net_device *netdev, struct ethtool_coalesce *ec)
+#endif
+{
+	struct nfb_ethdev *ethdev = netdev_priv(netdev);
+
+	ec->rx_coalesce_usecs = READ_ONCE(ethdev->kick_usecs_min);
+	ec->rx_coalesce_usecs_high = READ_ONCE(ethdev->kick_usecs_max);
+	return 0;
+}
+
+// The NAPI is kicked by a timer: rx-usecs is the period under load,
+// rx-usecs-high is the limit the period backs off to while idle
+#ifdef CONFIG_HAVE_ETHTOOL_KERNEL_COALESCE
+static int nfb_xdp_set_coalesce(struct net_device *netdev, struct ethtool_coalesce *ec,
+		struct kernel_ethtool_coalesce *kec, struct netlink_ext_ack *extack)
+#else
+static int nfb_xdp_set_coalesce(struct net_device *netdev, struct ethtool_coalesce *ec)
+#endif
+{
+	struct nfb_ethdev *ethdev = netdev_priv(netdev);
+
+	if (ec->rx_coalesce_usecs == 0 || ec->rx_coalesce_usecs_high < ec->rx_coalesce_usecs ||
+			ec->rx_coalesce_usecs_high > USEC_PER_SEC)
+		return -EINVAL;
+
+	// Running queues pick the new values up on the next rearm
+	WRITE_ONCE(ethdev->kick_usecs_min, ec->rx_coalesce_usecs);
+	WRITE_ONCE(ethdev->kick_usecs_max, ec->rx_coalesce_usecs_high);
+	return 0;
+}
+
+static const struct ethtool_ops nfb_xdp_ethtool_ops = {
+	.supported_coalesce_params = ETHTOOL_COALESCE_RX_USECS | ETHTOOL_COALESCE_RX_USECS_HIGH,
+	.get_link = ethtool_op_get_link,
+	.get_strings = nfb_xdp_get_strings,
+	.get_sset_count = nfb_xdp_get_sset_count,
+	.get_ethtool_stats = nfb_xdp_get_ethtool_stats,
+	.get_channels = nfb_xdp_get_channels,
+	.set_channels = nfb_xdp_set_channels,
+	.get_coalesce = nfb_xdp_get_coalesce,
+	.set_coalesce = nfb_xdp_set_coalesce,
+};
+
+void nfb_xdp_set_ethtool_ops(struct net_device *netdev)
+{
+	netdev->ethtool_ops = &nfb_xdp_ethtool_ops;
+}
@@ -62,6 +62,46 @@ struct ndp_subscription_sync {
 	__u64 swptr;
 };
 
+/**
+ * struct ndp_subscriber_poll
+ *
+ * @interval_min: initial period of the data check in poll, in microseconds
+ * @interval_max: maximal period of the data check in poll, in microseconds
+ *
+ * The period doubles with each check without new data.
+ * Zero value keeps the current setting; the effective values are returned.
+ */
+struct ndp_subscriber_poll {
+	__u32 interval_min;
+	__u32 interval_max;
+};
+
+/**
+ * struct ndp_subscription_sync_page - pointers shared through mmap
+ *
+ * @swptr: pointer written by software, read by the driver
+ * @hwptr: pointer written by the driver, read by software
+ *
+ * The driver refreshes the page periodically, so a shared RX queue can read
+ * new data without the NDP_IOC_SYNC call while the ring is not empty.
+ */
+struct ndp_subscription_sync_page {
+	__u64 swptr;
+	__u64 hwptr;
+};
+
+/**
+ * struct ndp_subscription_mmap
+ *
+ * @mmap_offset: offset of the area for the mmap call
+ * @mmap_size: size of the area for the mmap call
+ */
+struct ndp_subscription_mmap {
+	void *id;
+	__u64 mmap_offset;
+	__u64 mmap_size;
+};
+
 /*
  * NDP_IOC_SUBSCRIBE: Subscripe channel selected by index and type
  * 	- reads: index, type, flags
@@ -72,5 +112,7 @@ struct ndp_subscription_sync {
 #define NDP_IOC_START		_IOWR(NDP_IOC, 17, struct ndp_subscription_sync)
 #define NDP_IOC_STOP 		_IOWR(NDP_IOC, 18, struct ndp_subscription_sync)
 #define NDP_IOC_SYNC		_IOWR(NDP_IOC, 19, struct ndp_subscription_sync)
+#define NDP_IOC_POLL		_IOWR(NDP_IOC, 20, struct ndp_subscriber_poll)
+#define NDP_IOC_SYNC_PAGE	_IOWR(NDP_IOC, 21, struct ndp_subscription_mmap)
 
 #endif /* _LINUX_NDP_H_FILE_*/
@@ -18,11 +18,19 @@ struct nfb_lock {
 	uint64_t features;
 };
 
+struct nfb_lock_wait {
+	char *path;
+	uint64_t features;
+	int32_t timeout;        /* In ms, negative waits without limit */
+	uint32_t reserved;
+};
+
 /*
  * Ioctl definitions
  */
 #define NFB_LOCK_IOC		'l'
 #define NFB_LOCK_IOC_TRY_LOCK  _IOWR(NFB_LOCK_IOC, 2, struct nfb_lock)
 #define NFB_LOCK_IOC_UNLOCK    _IOWR(NFB_LOCK_IOC, 3, struct nfb_lock)
+#define NFB_LOCK_IOC_LOCK      _IOWR(NFB_LOCK_IOC, 4, struct nfb_lock_wait)
 
 #endif /* _LINUX_NFB_H_ */
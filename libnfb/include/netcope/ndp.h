@@ -10,6 +10,7 @@
 
 #include <nfb/ndp.h>
 #include "ndp_priv.h"
+#include "ndp_core_queue.h"
 
 #ifndef _NC_NDP_H_
 #define _NC_NDP_H_
@@ -17,6 +18,7 @@
 void ndp_close_queue(struct ndp_queue *q);
 
 int _ndp_queue_sync(struct nc_ndp_queue *q, struct ndp_subscription_sync *sync);
+int _ndp_queue_rx_release(struct nc_ndp_queue *q, struct ndp_subscription_sync *sync);
 int _ndp_queue_start(struct nc_ndp_queue *q);
 int _ndp_queue_stop(struct nc_ndp_queue *q);
 void _ndp_queue_init(struct ndp_queue *q, struct nfb_device *dev, int numa, int dir, int index);
@@ -76,6 +78,7 @@ static inline int nc_ndp_v2_open_queue(struct nc_ndp_queue *q, const void *fdt,
 	size_t off_mmap_size = 0;
 	off_t hdr_mmap_offset = 0;
 	off_t off_mmap_offset = 0;
+	off_t upd_mmap_offset = 0;
 #endif
 	struct ndp_queue_ops *ops = ndp_queue_get_ops(q->q);
 
@@ -120,10 +123,24 @@ static inline int nc_ndp_v2_open_queue(struct nc_ndp_queue *q, const void *fdt,
 	}
 
 	q->u.v2.hdr_items = hdr_mmap_size / 2 / sizeof(struct ndp_v2_packethdr);
+
+	/* Optional: older driver doesn't provide the update buffer */
+	q->u.v2.update_buff = NULL;
+	if (q->channel.type == NDP_CHANNEL_TYPE_RX &&
+			fdt_getprop64(fdt, fdt_offset, "upd_mmap_size", &q->u.v2.update_buff_size) == 0 &&
+			fdt_getprop64(fdt, fdt_offset, "upd_mmap_base", &upd_mmap_offset) == 0) {
+		q->u.v2.update_buff = mmap(NULL, q->u.v2.update_buff_size, PROT_READ, MAP_SHARED, q->fd, upd_mmap_offset);
+		if (q->u.v2.update_buff == MAP_FAILED)
+			q->u.v2.update_buff = NULL;
+	}
 #endif
 
 	if (q->channel.type == NDP_CHANNEL_TYPE_RX) {
 		ops->burst.rx.get = nc_ndp_v2_rx_burst_get;
+#if !defined(__KERNEL__) && defined(CONFIG_HAVE_MAVX2)
+		if (__builtin_cpu_supports("avx2"))
+			ops->burst.rx.get = nc_ndp_v2_rx_burst_get_avx2;
+#endif
 		ops->burst.rx.put = nc_ndp_v2_rx_burst_put;
 	} else {
 		ops->burst.tx.get = nc_ndp_v2_tx_burst_get;
@@ -254,6 +271,49 @@ static inline int nc_ndp_v3_close_queue(struct nc_ndp_queue *q)
 	return 0;
 }
 
+#ifndef __KERNEL__
+static int nc_ndp_queue_get_fd(void *priv)
+{
+	struct nc_ndp_queue *q = priv;
+
+	/* Pointers of the userspace mode queue are not known to the driver */
+	if (q->flags & NDP_CHANNEL_FLAG_USERSPACE)
+		return -ENOTSUP;
+
+	return q->fd;
+}
+#endif
+
+#ifndef __KERNEL__
+static inline void nc_ndp_queue_map_sync_page(struct nc_ndp_queue *q)
+{
+	void *page;
+	struct ndp_subscription_mmap req;
+
+	req.id = q->channel.id;
+
+	/* Not supported by older driver: the queue keeps using NDP_IOC_SYNC only */
+	if (ioctl(q->fd, NDP_IOC_SYNC_PAGE, &req))
+		return;
+
+	page = mmap(NULL, req.mmap_size, PROT_READ | PROT_WRITE,
+			MAP_FILE | MAP_SHARED, q->fd, req.mmap_offset);
+	if (page == MAP_FAILED)
+		return;
+
+	q->sync_page = page;
+	q->sync_page_size = req.mmap_size;
+}
+
+static inline void nc_ndp_queue_unmap_sync_page(struct nc_ndp_queue *q)
+{
+	if (q->sync_page) {
+		munmap(q->sync_page, q->sync_page_size);
+		q->sync_page = NULL;
+	}
+}
+#endif
+
 static inline int nc_ndp_queue_open_init_ext(const void *fdt, struct nc_ndp_queue *q, unsigned index, int dir, ndp_open_flags_t ndp_flags)
 {
 	int ret = 0;
@@ -327,6 +387,11 @@ static inline int nc_ndp_queue_open_init_ext(const void *fdt, struct nc_ndp_queu
 	if (q->buffer == MAP_FAILED) {
 		goto err_mmap;
 	}
+
+	/* Shared RX queue reads the hwptr from the page instead of the ioctl */
+	q->sync_page = NULL;
+	if (dir == NDP_CHANNEL_TYPE_RX && !(q->flags & NDP_CHANNEL_FLAG_EXCLUSIVE))
+		nc_ndp_queue_map_sync_page(q);
 #endif
 	q->sync.id = q->channel.id;
 
@@ -344,6 +409,12 @@ static inline int nc_ndp_queue_open_init_ext(const void *fdt, struct nc_ndp_queu
 	ops->control.start = nc_ndp_queue_start;
 	ops->control.stop = nc_ndp_queue_stop;
 
+	if (dir == NDP_CHANNEL_TYPE_RX)
+		ops->event.rx_available = nc_ndp_rx_available;
+#ifndef __KERNEL__
+	ops->event.get_fd = nc_ndp_queue_get_fd;
+#endif
+
 	if (ret)
 		goto err_vx_open_queue;
 
@@ -351,6 +422,7 @@ static inline int nc_ndp_queue_open_init_ext(const void *fdt, struct nc_ndp_queu
 
 err_vx_open_queue:
 #ifndef __KERNEL__
+	nc_ndp_queue_unmap_sync_page(q);
 	munmap(q->buffer, q->size * 2);
 err_mmap:
 #endif
@@ -370,6 +442,12 @@ static inline void nc_ndp_queue_close(struct nc_ndp_queue *q)
 	if (q->protocol == 3) {
 		nc_ndp_v3_close_queue(q);
 	}
+#ifndef __KERNEL__
+	if (q->protocol == 2 && q->u.v2.update_buff) {
+		munmap(q->u.v2.update_buff, q->u.v2.update_buff_size);
+		q->u.v2.update_buff = NULL;
+	}
+#endif
 
 #ifdef __KERNEL__
 	if (q->sub) {
@@ -377,6 +455,7 @@ static inline void nc_ndp_queue_close(struct nc_ndp_queue *q)
 		q->sub = NULL;
 	}
 #else
+	nc_ndp_queue_unmap_sync_page(q);
 	munmap(q->buffer, q->size * 2);
 #endif
 }
@@ -396,6 +475,10 @@ static int nc_ndp_queue_start(void *priv)
 	if ((ret = _ndp_queue_start(q)))
 		return ret;
 
+	/* The sync holds the swptr of the (re)started subscription */
+	if (q->channel.type == NDP_CHANNEL_TYPE_RX && q->protocol == 1)
+		nc_ndp_v1_rx_reset(q);
+
 	if (q->channel.type == NDP_CHANNEL_TYPE_RX && shared_q) {
 		if (q->protocol == 2)
 			q->u.v2.rhp = q->sync.hwptr;
@@ -428,7 +511,10 @@ static int nc_ndp_queue_stop(void *priv)
 		return ret;
 
 	if (q->protocol == 1) {
-		q->u.v1.bytes = 0;
+		if (q->channel.type == NDP_CHANNEL_TYPE_RX)
+			nc_ndp_v1_rx_reset(q);
+		else
+			q->u.v1.bytes = 0;
 	}
 	return 0;
 }
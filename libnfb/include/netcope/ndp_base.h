@@ -45,12 +45,37 @@ inline int _ndp_queue_sync(struct nc_ndp_queue *q, struct ndp_subscription_sync
 		return -ENOENT;
 	return ndp_subscription_sync(q->sub, sync);
 #else
+	uint64_t hwptr;
+
+	if (q->sync_page) {
+		/* The driver refreshes the hwptr in the page periodically,
+		 * the ioctl is needed only when no new data was published. */
+		__atomic_store_n(&q->sync_page->swptr, sync->swptr, __ATOMIC_RELEASE);
+		hwptr = __atomic_load_n(&q->sync_page->hwptr, __ATOMIC_ACQUIRE);
+		if (hwptr != sync->hwptr) {
+			sync->hwptr = hwptr;
+			return 0;
+		}
+	}
+
 	if (ioctl(q->fd, NDP_IOC_SYNC, sync))
 		return errno;
 	return 0;
 #endif
 }
 
+inline int _ndp_queue_rx_release(struct nc_ndp_queue *q, struct ndp_subscription_sync *sync)
+{
+#ifndef __KERNEL__
+	/* The driver passes the released space to the controller with next refresh */
+	if (q->sync_page) {
+		__atomic_store_n(&q->sync_page->swptr, sync->swptr, __ATOMIC_RELEASE);
+		return 0;
+	}
+#endif
+	return _ndp_queue_sync(q, sync);
+}
+
 inline int _ndp_queue_start(struct nc_ndp_queue *q)
 {
 #ifdef __KERNEL__
@@ -360,6 +360,20 @@ int ndp_queue_stop(struct ndp_queue *q)
 	return 0;
 }
 
+int ndp_queue_get_error(struct ndp_queue *q)
+{
+	int error = q->error;
+
+	q->error = 0;
+	return error;
+}
+
+void ndp_queue_get_error_stats(struct ndp_queue *q, struct ndp_queue_error_stats *stats)
+{
+	stats->errors = q->error_count;
+	stats->recovered = q->recover_count;
+}
+
 unsigned ndp_rx_burst_get(struct ndp_queue *q, struct ndp_packet *packets, unsigned count)
 {
 	return q->ops.burst.rx.get(q->priv, packets, count);
@@ -425,68 +439,175 @@ unsigned ndp_tx_burst_copy(struct ndp_queue *q, struct ndp_packet *packets, unsi
 	return packets_sent;
 }
 
-int ndp_rx_poll(struct nfb_device *dev, int timeout, struct ndp_queue **q)
+/* Upper bound of one sleep when some queue can't be waited on by its fd */
+#define NDP_RX_POLL_FALLBACK_INTERVAL 1
+
+int ndp_queue_get_fd(const struct ndp_queue *q)
 {
-	int ret = -ENXIO;
-	(void) dev;
-	(void) timeout;
-	(void) q;
+	if (q->ops.event.get_fd == NULL)
+		return -ENOTSUP;
 
-#if 0
+	return q->ops.event.get_fd(q->priv);
+}
+
+static inline int ndp_rx_poll_queue_valid(const struct ndp_queue *q)
+{
+	return q != NULL && q->dir == NDP_CHANNEL_TYPE_RX &&
+			q->status == NDP_QUEUE_RUNNING;
+}
+
+/* Collect RX queues with available data, the most occupied one goes into max_q.
+ * A queue which fails the check is skipped, the scan fails only when all of them do. */
+static int ndp_rx_poll_scan(struct nfb_device *dev, struct ndp_queue **queues, int count,
+		struct ndp_queue **max_q)
+{
 	int i;
-	struct pollfd pfd;
-	size_t size, max_size = 0;
+	int ret;
+	int ready = 0;
+	int max_size = 0;
+	int checked = 0;
+	int failed = 0;
+	int err = 0;
+	struct ndp_queue *q;
 
 	for (i = 0; i < dev->queue_count; i++) {
-		if (dev->queues[i] == NULL)
+		q = dev->queues[i];
+		if (!ndp_rx_poll_queue_valid(q) || q->ops.event.rx_available == NULL)
 			continue;
-		if (dev->queues[i]->version == 2) {
-			/* TODO */
-		} else if (dev->queues[i]->version == 1) {
-			nc_ndp_v1_rx_unlock(dev->queues[i]);
+
+		checked++;
+		ret = q->ops.event.rx_available(q->priv);
+		if (ret < 0) {
+			err = ret;
+			failed++;
+			continue;
+		}
+		if (ret == 0)
+			continue;
+
+		if (ret > max_size) {
+			max_size = ret;
+			if (max_q)
+				*max_q = q;
 		}
+		if (queues && ready < count)
+			queues[ready] = q;
+		ready++;
 	}
 
-	pfd.fd = dev->fd;
-	pfd.events = POLLIN;
+	/* Without any usable queue the wait would never end */
+	if (ready == 0 && failed && failed == checked)
+		return err;
 
-	ret = poll(&pfd, 1, timeout);
-	if (ret <= 0) {
-		if (ret < 0) {
-			ret = -errno;
+	return (queues && ready > count) ? count : ready;
+}
+
+/* Wait until the driver signals new data on any of the queue file descriptors */
+static int ndp_rx_poll_wait(struct nfb_device *dev, int timeout)
+{
+	int i, j;
+	int fd;
+	int ret;
+	int nfds = 0;
+	int fallback = 0;
+	struct pollfd *pfds;
+
+	pfds = malloc(sizeof(*pfds) * (dev->queue_count ? dev->queue_count : 1));
+	if (pfds == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < dev->queue_count; i++) {
+		if (!ndp_rx_poll_queue_valid(dev->queues[i]))
+			continue;
+
+		fd = ndp_queue_get_fd(dev->queues[i]);
+		if (fd < 0 || dev->queues[i]->ops.event.rx_available == NULL) {
+			fallback = 1;
+			continue;
+		}
+
+		/* Queues opened on the same device usually share the file descriptor */
+		for (j = 0; j < nfds; j++) {
+			if (pfds[j].fd == fd)
+				break;
+		}
+		if (j == nfds) {
+			pfds[nfds].fd = fd;
+			pfds[nfds].events = POLLIN;
+			nfds++;
 		}
-		goto err;
 	}
-	if (pfd.revents & POLLERR) {
-		ret = -1;
-		goto err;
+
+	if (nfds == 0 && !fallback) {
+		ret = -ENXIO;
+		goto err_no_queue;
 	}
 
-	ret = 0;
-	if (q) {
-		/* Find queue with biggest amount of data */
-		for (i = 0; i < dev->queue_count; i++) {
-			if (dev->queues[i] == NULL)
-				continue;
-			size = 0;
-			if (dev->queues[i]->version == 2) {
-				/* TODO */
-			} else if (dev->queues[i]->version == 1) {
-				nc_ndp_v1_rx_lock(dev->queues[i]);
-				size = dev->queues[i]->u.v1.bytes;
-			}
-			if (size)
-				ret++;
-			if (size > max_size) {
-				*q = dev->queues[i];
-				max_size = size;
+	if (fallback && (timeout < 0 || timeout > NDP_RX_POLL_FALLBACK_INTERVAL))
+		timeout = NDP_RX_POLL_FALLBACK_INTERVAL;
+
+	ret = poll(pfds, nfds, timeout);
+	if (ret < 0) {
+		ret = -errno;
+	} else {
+		for (i = 0; i < nfds; i++) {
+			if (pfds[i].revents & (POLLERR | POLLNVAL)) {
+				ret = -EIO;
+				break;
 			}
 		}
 	}
 
+err_no_queue:
+	free(pfds);
 	return ret;
-err:
-#endif
-	return ret;
+}
+
+static inline int64_t ndp_rx_poll_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int _ndp_rx_poll(struct nfb_device *dev, int timeout, struct ndp_queue **queues, int count,
+		struct ndp_queue **max_q)
+{
+	int ret;
+	int remaining = timeout;
+	int64_t deadline = 0;
+
+	if (timeout > 0)
+		deadline = ndp_rx_poll_now_ms() + timeout;
+
+	while (1) {
+		ret = ndp_rx_poll_scan(dev, queues, count, max_q);
+		if (ret != 0 || timeout == 0)
+			return ret;
+
+		if (timeout > 0) {
+			remaining = deadline - ndp_rx_poll_now_ms();
+			if (remaining <= 0)
+				return 0;
+		}
+
+		ret = ndp_rx_poll_wait(dev, remaining);
+		if (ret < 0)
+			return ret;
+	}
+}
+
+int ndp_rx_poll(struct nfb_device *dev, int timeout, struct ndp_queue **q)
+{
+	return _ndp_rx_poll(dev, timeout, NULL, 0, q);
+}
+
+int ndp_rx_poll_ext(struct nfb_device *dev, int timeout, struct ndp_queue **queues, int count)
+{
+	if (queues == NULL || count <= 0)
+		return -EINVAL;
+
+	return _ndp_rx_poll(dev, timeout, queues, count, NULL);
 }
 #endif
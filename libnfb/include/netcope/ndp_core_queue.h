@@ -25,6 +25,9 @@ struct ndp_queue {
 	struct nfb_device *dev;
 	enum ndp_queue_status status;
 	int numa;
+	int error;
+	unsigned long long error_count;
+	unsigned long long recover_count;
 	uint16_t dir;
 	uint16_t index;
 
@@ -61,6 +61,11 @@ struct nc_ndp_queue {
 
 			struct ndp_v2_packethdr *hdr;
 			struct ndp_v2_offsethdr *off;
+#ifndef __KERNEL__
+			/* Pointers written by controller, NULL if not mapped */
+			uint32_t *update_buff;
+			size_t update_buff_size;
+#endif
 		} v2;
 
 		struct {
@@ -110,6 +115,10 @@ struct nc_ndp_queue {
 
 #ifdef __KERNEL__
 	struct ndp_subscription *sub;
+#else
+	/* Pointers shared with driver for shared RX queues, NULL when not used */
+	struct ndp_subscription_sync_page *sync_page;
+	size_t sync_page_size;
 #endif
 
 	/* Control path */
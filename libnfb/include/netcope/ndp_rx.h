@@ -8,6 +8,10 @@
  *   Vladislav Valek <valekv@cesnet.cz>
  */
 
+#if !defined(__KERNEL__) && defined(CONFIG_HAVE_MAVX2)
+#include <immintrin.h>
+#endif
+
 static inline int nc_ndp_v1_rx_lock(void *priv)
 {
 	struct nc_ndp_queue *q = (struct nc_ndp_queue*) priv;
@@ -36,13 +40,42 @@ static inline int nc_ndp_v1_rx_unlock(void *priv)
 	q->u.v1.total -= unlock_bytes;
 	q->u.v1.swptr = 0;
 
-	if ((ret = _ndp_queue_sync(q, &q->sync))) {
+	if ((ret = _ndp_queue_rx_release(q, &q->sync))) {
 		return ret;
 	}
 
 	return 0;
 }
 
+/* Forget the locked data, the reading continues from the subscription swptr */
+static inline void nc_ndp_v1_rx_reset(struct nc_ndp_queue *q)
+{
+	q->u.v1.data = (unsigned char *)q->buffer + q->sync.swptr;
+	q->u.v1.swptr = 0;
+	q->u.v1.bytes = 0;
+	q->u.v1.total = 0;
+}
+
+/*
+ * Account an RX error on the queue. Userspace resynchronizes immediately:
+ * restarting the subscription drops the corrupted data and continues from hwptr.
+ * The kernel can't sleep here, the queue owner restarts it in process context.
+ */
+static inline void nc_ndp_rx_error(struct nc_ndp_queue *q, int error)
+{
+	struct ndp_queue *ndp_q = q->q;
+
+	ndp_q->error = error;
+	ndp_q->error_count++;
+
+#ifndef __KERNEL__
+	if (nc_ndp_queue_stop(q) == 0 && nc_ndp_queue_start(q) == 0)
+		ndp_q->recover_count++;
+	else
+		ndp_q->status = NDP_QUEUE_STOPPED;
+#endif
+}
+
 static inline unsigned nc_ndp_v1_rx_burst_get(void *priv, struct ndp_packet *packets, unsigned count)
 {
 	struct nc_ndp_queue *q = (struct nc_ndp_queue*) priv;
@@ -88,24 +121,19 @@ static inline unsigned nc_ndp_v1_rx_burst_get(void *priv, struct ndp_packet *pac
 
 		/* check packet header */
 		if (unlikely(packet_size == 0 || header_size > packet_size - NDP_PACKET_HEADER_SIZE)) {
-			nc_ndp_queue_stop(q);
-			ndp_close_queue(q->q);
 #ifdef __KERNEL__
-                        printk(KERN_ERR "%s: NDP packet header malformed %d\n", __func__, packet_size);
-			return 0;
-#else
-			errx(5, "NDP packet header malformed %d", packet_size);
+			printk_ratelimited(KERN_ERR "%s: NDP packet header malformed %d\n", __func__, packet_size);
 #endif
+			nc_ndp_rx_error(q, EBADMSG);
+			return 0;
 		}
 		/* check locked space */
 		if (unlikely(packet_size > bytes)) {
-			nc_ndp_queue_stop(q);
-			ndp_close_queue(q->q);
 #ifdef __KERNEL__
-			return 0;
-#else
-			errx(15, "NDP sync error");
+			printk_ratelimited(KERN_ERR "%s: NDP sync error\n", __func__);
 #endif
+			nc_ndp_rx_error(q, EPIPE);
+			return 0;
 		}
 
 		packets->flags = 0;
@@ -144,12 +172,24 @@ static inline int nc_ndp_v1_rx_burst_put(void *priv)
 	return 0;
 }
 
+/* Check the header pointer, which the controller writes to the update buffer */
+static inline int nc_ndp_v2_rx_hwptr_moved(struct nc_ndp_queue *q)
+{
+#ifndef __KERNEL__
+	if (q->u.v2.update_buff)
+		return __atomic_load_n(&q->u.v2.update_buff[1], __ATOMIC_ACQUIRE) != q->sync.hwptr;
+#endif
+	return 1;
+}
+
 static inline unsigned nc_ndp_v2_rx_lock(void *priv)
 {
 	struct nc_ndp_queue *q = (struct nc_ndp_queue*) priv;
 
 	int ret;
-	if ((ret = _ndp_queue_sync(q, &q->sync))) {
+
+	/* Without new data from the controller the sync can be skipped */
+	if (nc_ndp_v2_rx_hwptr_moved(q) && (ret = _ndp_queue_sync(q, &q->sync))) {
 		return ret;
 	}
 
@@ -168,7 +208,7 @@ static inline int nc_ndp_v2_rx_unlock(void *priv)
 	int ret;
 	q->sync.swptr = q->u.v2.rhp & (q->u.v2.hdr_items-1);
 
-	if ((ret = _ndp_queue_sync(q, &q->sync))) {
+	if ((ret = _ndp_queue_rx_release(q, &q->sync))) {
 		return ret;
 	}
 	return 0;
@@ -225,6 +265,111 @@ static inline unsigned nc_ndp_v2_rx_burst_get(void *priv, struct ndp_packet *pac
 	return count;
 }
 
+#if !defined(__KERNEL__) && defined(CONFIG_HAVE_MAVX2)
+/* The AVX2 decoder stores whole ndp_packet structures assembled in vector registers.
+ * The array size goes negative on an unexpected layout (C99 has no _Static_assert). */
+typedef char nc_ndp_v2_rx_avx2_packet_layout_check[(
+		sizeof(struct ndp_packet) == 24 &&
+		offsetof(struct ndp_packet, data) == 0 &&
+		offsetof(struct ndp_packet, header) == 8 &&
+		offsetof(struct ndp_packet, data_length) == 16 &&
+		offsetof(struct ndp_packet, header_length) == 20 &&
+		offsetof(struct ndp_packet, flags) == 22) ? 1 : -1];
+
+/*
+ * Decodes four hdr/off pairs per iteration: the packet headers are split into
+ * lengths and flags, the offsets are turned into pointers and the results are
+ * transposed into three 32 B stores, which cover four ndp_packet structures.
+ */
+__attribute__((target("avx2")))
+static inline unsigned nc_ndp_v2_rx_burst_get_avx2(void *priv, struct ndp_packet *packets, unsigned count)
+{
+	struct nc_ndp_queue *q = (struct nc_ndp_queue*) priv;
+
+	unsigned i;
+	unsigned char *data_base = q->buffer;
+	struct ndp_v2_packethdr *hdr_base;
+	struct ndp_v2_offsethdr *off_base;
+
+	__m256i base, mask32, mask16, mask8, mask4;
+
+	if (unlikely(q->u.v2.pkts_available < count)) {
+		nc_ndp_v2_rx_lock(q);
+		count = min(q->u.v2.pkts_available, count);
+		if (count == 0)
+			return 0;
+	}
+
+	hdr_base = q->u.v2.hdr + q->u.v2.rhp;
+	off_base = q->u.v2.off + q->u.v2.rhp;
+	__builtin_prefetch(hdr_base);
+	__builtin_prefetch(off_base);
+
+	base = _mm256_set1_epi64x((long long) data_base);
+	mask32 = _mm256_set1_epi64x(0xFFFFFFFF);
+	mask16 = _mm256_set1_epi64x(0xFFFF);
+	mask8 = _mm256_set1_epi64x(0xFF);
+	mask4 = _mm256_set1_epi64x(0xF);
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		__m256i hdr, off, psize, hsize, flags;
+		__m256i vdata, vhdr, vmeta;
+
+		/* Four packed 32b packet headers, zero extended to 64b lanes */
+		hdr = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *) (hdr_base + i)));
+		off = _mm256_loadu_si256((const __m256i *) (off_base + i));
+
+		psize = _mm256_and_si256(hdr, mask16);
+		hsize = _mm256_and_si256(_mm256_srli_epi64(hdr, 16), mask8);
+		flags = _mm256_and_si256(_mm256_srli_epi64(hdr, 24), mask4);
+
+		/* Lanes of the three ndp_packet qwords: data, header, lengths + flags */
+		vhdr = _mm256_add_epi64(base, off);
+		vdata = _mm256_add_epi64(vhdr, hsize);
+		vmeta = _mm256_or_si256(_mm256_and_si256(_mm256_sub_epi64(psize, hsize), mask32),
+				_mm256_or_si256(_mm256_slli_epi64(hsize, 32), _mm256_slli_epi64(flags, 48)));
+
+		/* Transpose [d0 d1 d2 d3] [h0 h1 h2 h3] [m0 m1 m2 m3] into
+		 * [d0 h0 m0 d1] [h1 m1 d2 h2] [m2 d3 h3 m3] */
+		vdata = _mm256_permute4x64_epi64(vdata, _MM_SHUFFLE(1, 2, 3, 0));
+		vhdr = _mm256_permute4x64_epi64(vhdr, _MM_SHUFFLE(2, 3, 0, 1));
+		vmeta = _mm256_permute4x64_epi64(vmeta, _MM_SHUFFLE(3, 0, 1, 2));
+
+		_mm256_storeu_si256((__m256i *) (packets + i) + 0,
+				_mm256_blend_epi32(_mm256_blend_epi32(vdata, vhdr, 0x0C), vmeta, 0x30));
+		_mm256_storeu_si256((__m256i *) (packets + i) + 1,
+				_mm256_blend_epi32(_mm256_blend_epi32(vhdr, vmeta, 0x0C), vdata, 0x30));
+		_mm256_storeu_si256((__m256i *) (packets + i) + 2,
+				_mm256_blend_epi32(_mm256_blend_epi32(vmeta, vdata, 0x0C), vhdr, 0x30));
+	}
+
+	for (; i < count; i++) {
+		unsigned packet_size;
+		unsigned header_size;
+		struct ndp_v2_packethdr *hdr;
+		struct ndp_v2_offsethdr *off;
+
+		hdr = hdr_base + i;
+		off = off_base + i;
+
+		packet_size = le16_to_cpu(hdr->packet_size);
+		header_size = hdr->header_size;
+
+		packets[i].header = data_base + off->offset;
+		packets[i].header_length = header_size;
+		packets[i].flags = hdr->flags & 0xF;
+
+		packets[i].data = data_base + off->offset + header_size;
+		packets[i].data_length = packet_size - header_size;
+	}
+
+	q->u.v2.rhp += count;
+	q->u.v2.pkts_available -= count;
+
+	return count;
+}
+#endif
+
 static inline int nc_ndp_v2_rx_burst_put(void *priv)
 {
 	return nc_ndp_v2_rx_unlock(priv);
@@ -301,7 +446,7 @@ static inline int nc_ndp_v3_rx_unlock(void *priv)
 	if (q->flags & NDP_CHANNEL_FLAG_USERSPACE) {
 		_ndp_queue_rx_sync_v3_us(q);
 	} else {
-		ret = _ndp_queue_sync(q, &q->sync);
+		ret = _ndp_queue_rx_release(q, &q->sync);
 	}
 
 	// When pointer wraps around, flip the valid flag.
@@ -403,3 +548,61 @@ static inline void nc_ndp_rx_burst_put(void *priv)
 		nc_ndp_v1_rx_burst_put(priv);
 	}
 }
+
+static inline int nc_ndp_rx_available_clamp(uint64_t count)
+{
+	return count > INT_MAX ? INT_MAX : (int) count;
+}
+
+/* Data available from the hwptr published by the driver, without the sync */
+static inline int nc_ndp_rx_available_at(struct nc_ndp_queue *q, uint64_t hwptr)
+{
+	if (q->protocol == 3)
+		return nc_ndp_rx_available_clamp((hwptr - q->u.v3.shp) & q->u.v3.hdr_ptr_mask);
+	else if (q->protocol == 2)
+		return nc_ndp_rx_available_clamp((hwptr - q->u.v2.rhp) & (q->u.v2.hdr_items - 1));
+	else if (q->protocol == 1)
+		return nc_ndp_rx_available_clamp((hwptr - q->sync.swptr - q->u.v1.swptr) & (q->size - 1));
+	return -ENXIO;
+}
+
+static inline int nc_ndp_rx_available(void *priv)
+{
+	int ret;
+	struct nc_ndp_queue *q = (struct nc_ndp_queue*) priv;
+
+	/* Data locked by the previous sync and not read yet */
+	if (q->protocol == 3 && q->u.v3.pkts_available)
+		return nc_ndp_rx_available_clamp(q->u.v3.pkts_available);
+	else if (q->protocol == 2 && q->u.v2.pkts_available)
+		return nc_ndp_rx_available_clamp(q->u.v2.pkts_available);
+	else if (q->protocol == 1 && q->u.v1.bytes)
+		return nc_ndp_rx_available_clamp(q->u.v1.bytes);
+
+#ifndef __KERNEL__
+	/* The driver refreshes the hwptr in the sync page: the poll loop
+	 * over many queues doesn't need a syscall for each one of them.
+	 * The page never holds an older hwptr than the last sync returned. */
+	if (q->sync_page && !(q->protocol == 3 && (q->flags & NDP_CHANNEL_FLAG_USERSPACE)))
+		return nc_ndp_rx_available_at(q, __atomic_load_n(&q->sync_page->hwptr, __ATOMIC_ACQUIRE));
+#endif
+
+	/* The lock functions only refresh the view of the ring,
+	 * so they are safe to call between burst_get and burst_put */
+	if (q->protocol == 3) {
+		ret = nc_ndp_v3_rx_lock(q);
+		if (ret == 0)
+			return q->u.v3.pkts_available;
+	} else if (q->protocol == 2) {
+		ret = nc_ndp_v2_rx_lock(q);
+		if (ret == 0)
+			return q->u.v2.pkts_available;
+	} else if (q->protocol == 1) {
+		ret = nc_ndp_v1_rx_lock(q);
+		if (ret == 0)
+			return nc_ndp_rx_available_clamp(q->u.v1.bytes);
+	} else {
+		return -ENXIO;
+	}
+	return ret < 0 ? ret : -ret;
+}
@@ -10,6 +10,9 @@
 
 #define NDP_TX_BURST_COPY_ATTEMPTS 1000
 
+static inline int nc_ndp_v1_tx_burst_flush(void *priv);
+static inline int nc_ndp_v2_tx_burst_flush(void *priv);
+
 /*
  * Before the IOCTL SYNC call without active lock:
  * - hwptr offset is invalid, but the value is used by driver to compute requesting size:
@@ -117,6 +120,10 @@ static inline unsigned nc_ndp_v1_tx_burst_get(void *priv, struct ndp_packet *pac
 				q->u.v1.data  = orig_data;
 				q->u.v1.swptr = orig_swptr;
 				q->u.v1.bytes = orig_bytes;
+				/* The lock can't grow (full ring or other subscriber waits):
+				 * publish pending data and let the lock go */
+				if (orig_swptr)
+					nc_ndp_v1_tx_burst_flush(q);
 				return 0;
 			}
 		}
@@ -203,6 +210,9 @@ static inline unsigned nc_ndp_v2_tx_burst_get(void *priv, struct ndp_packet *pac
 	if (unlikely(q->u.v2.pkts_available < count)) {
 		nc_ndp_v2_tx_lock(q);
 		if (unlikely(q->u.v2.pkts_available < count || count == 0)) {
+			/* The lock can't grow: publish pending packets and let the lock go */
+			if ((q->u.v2.rhp - q->sync.hwptr) & (q->u.v2.hdr_items-1))
+				nc_ndp_v2_tx_burst_flush(q);
 			return 0;
 		}
 	}
@@ -251,8 +261,6 @@ static inline unsigned nc_ndp_v2_tx_burst_get(void *priv, struct ndp_packet *pac
 	return count;
 }
 
-static inline int nc_ndp_v2_tx_burst_flush(void *priv);
-
 static inline int nc_ndp_v2_tx_burst_put(void *priv)
 {
 	struct nc_ndp_queue *q = (struct nc_ndp_queue*) priv;
@@ -521,33 +529,93 @@ static inline int nc_ndp_v3_tx_burst_flush(void *priv)
 	return 0;
 }
 
+/* Copy data of consecutive frames to the card, split at the end of data buffer */
+static inline void nc_ndp_v3_tx_write_data(struct nc_ndp_queue *q, const unsigned char *data, uint32_t len, uint32_t ptr)
+{
+	uint32_t part = q->u.v3.data_ptr_mask + 1 - ptr;
+
+	if (len == 0)
+		return;
+
+	if (part > len)
+		part = len;
+
+	nfb_comp_write(q->u.v3.tx_data_buff, data, part, ptr);
+	if (part < len)
+		nfb_comp_write(q->u.v3.tx_data_buff, data + part, len - part, 0);
+#ifdef __KERNEL__
+	wmb();
+#endif
+}
+
+/* Copy headers of consecutive frames to the card, split at the end of header buffer */
+static inline void nc_ndp_v3_tx_write_hdrs(struct nc_ndp_queue *q, const struct ndp_v3_packethdr *hdr, uint32_t count, uint32_t shp)
+{
+	uint32_t part = q->u.v3.hdr_ptr_mask + 1 - shp;
+
+	if (count == 0)
+		return;
+
+	if (part > count)
+		part = count;
+
+	nfb_comp_write(q->u.v3.tx_hdr_buff, hdr, part * sizeof(*hdr), (uint64_t)shp * sizeof(*hdr));
+	if (part < count)
+		nfb_comp_write(q->u.v3.tx_hdr_buff, hdr + part, (count - part) * sizeof(*hdr), 0);
+}
+
+/*
+ * Frames of one burst are stored consecutively in the buffer with the same
+ * layout as in the card: the contiguous run of frames is copied by one
+ * write (wide WC stores with one fence), followed by one write of all
+ * headers. The headers must not overtake the data.
+ */
 static inline int nc_ndp_v3_tx_burst_put(void *priv)
 {
 	struct nc_ndp_queue *q = (struct nc_ndp_queue*) priv;
 
-	unsigned i;
+	unsigned i, first = 0;
 	uint32_t frame_len_ceil;
 	struct ndp_v3_packethdr *hdr = q->u.v3.hdrs - q->u.v3.pkts_to_send;
-	uint32_t shp = q->u.v3.shp - q->u.v3.pkts_to_send;
+	uint32_t shp = (q->u.v3.shp - q->u.v3.pkts_to_send) & q->u.v3.hdr_ptr_mask;
 
-	for (i = 0; i < q->u.v3.pkts_to_send; i++) {
+	unsigned char *run_data = NULL;
+	uint32_t run_ptr = 0;
+	uint32_t run_len = 0;
+	uint32_t run_space = 0;
 
+	for (i = 0; i < q->u.v3.pkts_to_send; i++) {
 		frame_len_ceil = (hdr[i].frame_len + (NDP_TX_CALYPTE_BLOCK_SIZE -1)) & (~(NDP_TX_CALYPTE_BLOCK_SIZE -1));
 
-		while (q->u.v3.bytes_available < frame_len_ceil) {
-			if (nc_ndp_v3_tx_request_space(q, shp))
-				return -1;
+		if (q->u.v3.bytes_available < frame_len_ceil) {
+			/* Submit already copied frames, the driver frees space only behind them */
+			nc_ndp_v3_tx_write_data(q, run_data, run_len, run_ptr);
+			nc_ndp_v3_tx_write_hdrs(q, hdr + first, i - first, shp);
+			shp = (shp + i - first) & (q->u.v3.hdr_ptr_mask);
+			first = i;
+			run_len = run_space = 0;
+
+			while (q->u.v3.bytes_available < frame_len_ceil) {
+				if (nc_ndp_v3_tx_request_space(q, shp))
+					return -1;
+			}
+		}
+
+		if (run_space == 0 || (unsigned char *) q->u.v3.tx_pkts[i] != run_data + run_space) {
+			nc_ndp_v3_tx_write_data(q, run_data, run_len, run_ptr);
+			run_data = q->u.v3.tx_pkts[i];
+			run_ptr = hdr[i].frame_ptr;
+			run_space = 0;
 		}
 
-		nfb_comp_write(q->u.v3.tx_data_buff, q->u.v3.tx_pkts[i], hdr[i].frame_len, hdr[i].frame_ptr);
+		run_len = run_space + hdr[i].frame_len;
+		run_space += frame_len_ceil;
 		q->u.v3.bytes_available -= frame_len_ceil;
-#ifdef __KERNEL__
-		wmb();
-#endif
-		nfb_comp_write(q->u.v3.tx_hdr_buff, &hdr[i], 8, (uint64_t)shp*8);
-		// This below line needs to updated somewhere
-		shp = (shp + 1) & (q->u.v3.hdr_ptr_mask);
 	}
+
+	nc_ndp_v3_tx_write_data(q, run_data, run_len, run_ptr);
+	nc_ndp_v3_tx_write_hdrs(q, hdr + first, i - first, shp);
+
 	q->u.v3.pkts_to_send = 0;
 	nc_ndp_v3_tx_burst_flush(priv);
 
@@ -17,6 +17,7 @@ extern "C" {
 #endif
 
 #define NFB_FW_LOAD_FLAG_VERBOSE 0x01
+#define NFB_FW_LOAD_FLAG_DELTA   0x02 /* Rewrite only the changed flash blocks and verify them */
 
 struct nfb_device;
 
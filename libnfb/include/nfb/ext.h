@@ -67,6 +67,9 @@ typedef unsigned (*ndp_tx_burst_get_t)(void *priv, struct ndp_packet *packets, u
 typedef int (*ndp_tx_burst_put_t)(void *priv);
 typedef int (*ndp_tx_burst_flush_t)(void *priv);
 
+typedef int (*ndp_queue_get_fd_t)(void *priv);
+typedef int (*ndp_rx_available_t)(void *priv);
+
 struct ndp_queue_ops {
 	/* Fast path */
 	union {
@@ -86,6 +89,12 @@ struct ndp_queue_ops {
 		int (*start)(void *priv);
 		int (*stop)(void *priv);
 	} control;
+
+	/* Event path (optional, used by ndp_rx_poll) */
+	struct {
+		ndp_queue_get_fd_t get_fd;
+		ndp_rx_available_t rx_available;
+	} event;
 };
 
 struct ndp_queue * ndp_queue_create(struct nfb_device *dev, int numa, int type, int index);
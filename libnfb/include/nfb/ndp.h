@@ -176,6 +176,33 @@ int ndp_queue_start(struct ndp_queue *queue);
  */
 int ndp_queue_stop(struct ndp_queue *queue);
 
+/*!
+ * \brief NDP queue error counters
+ */
+struct ndp_queue_error_stats {
+	unsigned long long errors;      //!< Count of detected ring errors (malformed header, lost sync)
+	unsigned long long recovered;   //!< Count of successful automatic queue restarts
+};
+
+/*!
+ * \brief Get and clear the error state of the queue
+ * \param[in] queue     NDP queue
+ * \return 0 if no error occured since the last call, otherwise error code:
+ *         EBADMSG for a malformed packet header, EPIPE for lost synchronization
+ *
+ * When \ref ndp_rx_burst_get detects a corrupted ring, it returns 0, records
+ * the error and restarts the queue, which continues with newly received data.
+ * If the restart fails, the queue is left stopped. Other queues are not affected.
+ */
+int ndp_queue_get_error(struct ndp_queue *queue);
+
+/*!
+ * \brief Get error counters of the queue
+ * \param[in]  queue    NDP queue
+ * \param[out] stats    Error counters
+ */
+void ndp_queue_get_error_stats(struct ndp_queue *queue, struct ndp_queue_error_stats *stats);
+
 /*!
  * \brief Aquire buffer size for queue in number of NDP packets
  * \param[in] q         NDP queue
@@ -199,7 +226,7 @@ unsigned ndp_get_buffer_item_count(ndp_tx_queue_t *q);
  * \param[in]  queue    NDP RX queue
  * \param[out] packets  Array of NDP packet structs
  * \param[in]  count    Maximal count of packets to read (length of \p packets)
- * \return Count of actually read packets
+ * \return Count of actually read packets; 0 also on a ring error, see \ref ndp_queue_get_error
  *
  * \note Traffic must be started (see \ref ndp_queue_start)
  *
@@ -428,8 +455,52 @@ int ndp_print_packet(const struct ndp_packet *packet, unsigned print_options);
 
 /*! @} */ // end of group: auxiliary functions
 
+/*! ---- POLL ------------------------------------------------------------------
+ * @defgroup poll_functions Poll functions
+ *
+ * Wait for data on the opened and started RX queues of the device
+ * without the need to busy-poll the ndp_rx_burst_get function.
+ *
+ * @{
+ */
+
+/*!
+ * \brief Get file descriptor usable for waiting on the queue with poll/epoll
+ * \param[in] queue  NDP queue
+ * \return File descriptor on success, negative error code otherwise
+ *
+ * The POLLIN event is signalled when the driver has new data for any RX queue
+ * opened on the same NFB device handle, so the descriptor can be shared
+ * by more queues. Use a separate device handle per queue when per-queue
+ * wakeups are required. The descriptor is not available for queues opened
+ * with the NDP_OPEN_FLAG_USERSPACE flag.
+ */
+int ndp_queue_get_fd(const struct ndp_queue *queue);
+
+/*!
+ * \brief Wait for data on the RX queues opened on the device
+ * \param[in]  dev      NFB device
+ * \param[in]  timeout  Timeout in milliseconds, zero returns immediately, negative value waits infinitely
+ * \param[out] queue    The queue with the largest amount of available data (can be NULL)
+ * \return Number of queues with available data, zero on timeout, negative error code otherwise
+ *
+ * A queue which fails the check for available data is skipped, the call fails
+ * only when the check fails for all the running RX queues.
+ */
 int ndp_rx_poll(struct nfb_device *dev, int timeout, struct ndp_queue **queue);
 
+/*!
+ * \brief Wait for data on the RX queues opened on the device
+ * \param[in]  dev      NFB device
+ * \param[in]  timeout  Timeout in milliseconds, zero returns immediately, negative value waits infinitely
+ * \param[out] queues   Caller-owned array filled with queues having available data
+ * \param[in]  count    Size of the queues array
+ * \return Number of filled queues, zero on timeout, negative error code otherwise
+ */
+int ndp_rx_poll_ext(struct nfb_device *dev, int timeout, struct ndp_queue **queues, int count);
+
+/*! @} */ // end of group: poll functions
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
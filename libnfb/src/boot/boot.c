@@ -13,6 +13,8 @@
 #include <string.h>
 #include <libgen.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <sys/ioctl.h>
 #include <sys/fcntl.h>
 #include <sys/eventfd.h>
@@ -563,6 +565,89 @@ void nfb_fw_load_progress_print(void *priv)
 	}
 }
 
+/* Incremental write: read back every erase block, rewrite and verify only the changed ones */
+static int nfb_fw_load_mtd_delta(const struct nfb_device *dev, struct nfb_boot_ioc_mtd *mtd, int erasesize, const char *data, size_t size, int flags)
+{
+	int ret = 0;
+	int i;
+	int blocks;
+	int changed = 0;
+	size_t len;
+	unsigned long address = mtd->addr;
+	char *expected, *readback;
+	struct timespec start, end;
+	double elapsed;
+
+	blocks = ((size - 1) / erasesize) + 1;
+
+	expected = malloc(erasesize * 2);
+	if (expected == NULL)
+		return ENOMEM;
+	readback = expected + erasesize;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < blocks; i++) {
+		if (flags & NFB_FW_LOAD_FLAG_VERBOSE)
+			nfb_fw_print_progress("Updating Flash: %3d%%", i * 100 / blocks);
+
+		/* Tail of the last block stays erased, the same as after the full write */
+		len = size - (size_t) i * erasesize;
+		if (len > (size_t) erasesize)
+			len = erasesize;
+		memcpy(expected, data + (size_t) i * erasesize, len);
+		memset(expected + len, 0xFF, erasesize - len);
+
+		mtd->addr = address + (size_t) i * erasesize;
+		mtd->size = erasesize;
+		mtd->data = readback;
+		if (ioctl(dev->fd, NFB_BOOT_IOC_MTD_READ, mtd) == -1) {
+			ret = errno;
+			goto err_ioctl;
+		}
+		if (memcmp(expected, readback, erasesize) == 0)
+			continue;
+
+		changed++;
+		if (ioctl(dev->fd, NFB_BOOT_IOC_MTD_ERASE, mtd) == -1) {
+			ret = errno;
+			goto err_ioctl;
+		}
+
+		mtd->size = len;
+		mtd->data = expected;
+		if (ioctl(dev->fd, NFB_BOOT_IOC_MTD_WRITE, mtd) == -1) {
+			ret = errno;
+			goto err_ioctl;
+		}
+
+		mtd->size = erasesize;
+		mtd->data = readback;
+		if (ioctl(dev->fd, NFB_BOOT_IOC_MTD_READ, mtd) == -1) {
+			ret = errno;
+			goto err_ioctl;
+		}
+		if (memcmp(expected, readback, erasesize) != 0) {
+			ret = EIO;
+			goto err_verify;
+		}
+	}
+
+	if (flags & NFB_FW_LOAD_FLAG_VERBOSE) {
+		nfb_fw_print_progress("Updating Flash: %3d%%", 100);
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+		printf("Changed %d of %d blocks in %.1f s (%.2f MiB/s)\n", changed, blocks, elapsed,
+				elapsed > 0 ? size / elapsed / (1024 * 1024) : 0.0);
+	}
+
+err_verify:
+err_ioctl:
+	free(expected);
+	return ret;
+}
+
 int nfb_fw_load_ext_name(const struct nfb_device *dev, unsigned int image, void *data, size_t size, int flags, const char *filename)
 {
 	int ret;
@@ -649,6 +734,9 @@ int nfb_fw_load_ext_name(const struct nfb_device *dev, unsigned int image, void
 	if (flags & NFB_FW_LOAD_FLAG_VERBOSE)
 		printf("Bitstream size: %lu B (%d blocks)\n", size, blocks);
 
+	if (flags & NFB_FW_LOAD_FLAG_DELTA)
+		return nfb_fw_load_mtd_delta(dev, &mtd, mtd_info.erasesize, data, size, flags);
+
 	for (i = 0; i < blocks; i++) {
 		if (flags & NFB_FW_LOAD_FLAG_VERBOSE)
 			nfb_fw_print_progress("Erasing Flash: %3d%%", i * 100 / blocks);
@@ -9,10 +9,12 @@
 
 #include <assert.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <numa.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include <unistd.h>
 #include <arpa/inet.h>
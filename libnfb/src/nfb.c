@@ -15,6 +15,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include <dlfcn.h>
@@ -34,6 +35,7 @@ void nfb_base_close(void *priv);
 int nfb_bus_open_mi(void *dev_priv, int bus_node, int comp_node, void ** bus_priv, struct libnfb_bus_ext_ops* ops);
 void nfb_bus_close_mi(void *bus_priv);
 int nfb_base_comp_lock(const struct nfb_comp *comp, uint32_t features);
+int nfb_base_comp_lock_wait(const struct nfb_comp *comp, uint32_t features, int timeout);
 void nfb_base_comp_unlock(const struct nfb_comp *comp, uint32_t features);
 
 int ndp_base_queue_open(struct nfb_device *dev, void *dev_priv, unsigned index, int dir, int flags, struct ndp_queue ** pq);
@@ -173,6 +175,126 @@ int load_extension(const char **devname, struct nfb_device *dev)
 	return ret;
 }
 
+struct nfb_comp_index_item {
+	const char *compatible;
+	int offset;
+};
+
+static int nfb_comp_index_item_cmp(const void *a, const void *b)
+{
+	const struct nfb_comp_index_item *ia = a;
+	const struct nfb_comp_index_item *ib = b;
+	int ret;
+
+	ret = strcmp(ia->compatible, ib->compatible);
+	if (ret)
+		return ret;
+	return ia->offset - ib->offset;
+}
+
+static int nfb_comp_index_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct nfb_comp_index *) a)->compatible,
+			((const struct nfb_comp_index *) b)->compatible);
+}
+
+/**
+ * nfb_comp_index_build() - index FDT node offsets by compatible strings
+ *
+ * @dev: NFB device with a valid FDT
+ *
+ * One walk through the FDT instead of a walk per nfb_comp_find call.
+ * Every string of the compatible stringlist gets the node.
+ */
+static int nfb_comp_index_build(struct nfb_device *dev)
+{
+	const void *fdt = dev->fdt;
+	const char *str, *end;
+	int node, len;
+	int i, count = 0, alloc = 0;
+	int entries = 0;
+	struct nfb_comp_index_item *items = NULL, *tmp;
+	struct nfb_comp_index *index;
+
+	for (node = fdt_next_node(fdt, -1, NULL); node >= 0; node = fdt_next_node(fdt, node, NULL)) {
+		str = fdt_getprop(fdt, node, "compatible", &len);
+		if (str == NULL || len <= 0 || str[len - 1] != '\0')
+			continue;
+
+		for (end = str + len; str < end; str += strnlen(str, end - str) + 1) {
+			if (count == alloc) {
+				alloc = alloc ? alloc * 2 : 256;
+				tmp = realloc(items, alloc * sizeof(*items));
+				if (tmp == NULL)
+					goto err_alloc_items;
+				items = tmp;
+			}
+			items[count].compatible = str;
+			items[count].offset = node;
+			count++;
+		}
+	}
+
+	if (count == 0) {
+		free(items);
+		return 0;
+	}
+
+	qsort(items, count, sizeof(*items), nfb_comp_index_item_cmp);
+	for (i = 0; i < count; i++) {
+		if (i == 0 || strcmp(items[i - 1].compatible, items[i].compatible))
+			entries++;
+	}
+
+	dev->comp_index_offsets = malloc(count * sizeof(*dev->comp_index_offsets));
+	if (dev->comp_index_offsets == NULL)
+		goto err_alloc_offsets;
+
+	dev->comp_index = malloc(entries * sizeof(*dev->comp_index));
+	if (dev->comp_index == NULL)
+		goto err_alloc_index;
+
+	index = dev->comp_index - 1;
+	for (i = 0; i < count; i++) {
+		if (i == 0 || strcmp(items[i - 1].compatible, items[i].compatible)) {
+			index++;
+			index->compatible = items[i].compatible;
+			index->count = 0;
+			index->offsets = dev->comp_index_offsets + i;
+		}
+		index->offsets[index->count++] = items[i].offset;
+	}
+	dev->comp_index_count = entries;
+
+	free(items);
+	return 0;
+
+err_alloc_index:
+	free(dev->comp_index_offsets);
+	dev->comp_index_offsets = NULL;
+err_alloc_offsets:
+err_alloc_items:
+	free(items);
+	return -ENOMEM;
+}
+
+static void nfb_comp_index_free(struct nfb_device *dev)
+{
+	free(dev->comp_index);
+	free(dev->comp_index_offsets);
+	dev->comp_index = NULL;
+	dev->comp_index_offsets = NULL;
+	dev->comp_index_count = 0;
+}
+
+static const struct nfb_comp_index *nfb_comp_index_find(const struct nfb_device *dev, const char *compatible)
+{
+	struct nfb_comp_index key;
+
+	key.compatible = compatible;
+	return bsearch(&key, dev->comp_index, dev->comp_index_count, sizeof(key), nfb_comp_index_cmp);
+}
+
 struct nfb_device *nfb_open_ext(const char *devname, int oflag)
 {
 	int ret;
@@ -232,6 +354,9 @@ struct nfb_device *nfb_open_ext(const char *devname, int oflag)
 		goto err_fdt_check_header;
 	}
 
+	/* Lookups fall back to FDT scan when the index can't be built */
+	nfb_comp_index_build(dev);
+
 	return dev;
 
 err_fdt_check_header:
@@ -313,6 +438,7 @@ struct nfb_device *nfb_open(const char *devname)
 
 void nfb_close(struct nfb_device *dev)
 {
+	nfb_comp_index_free(dev);
 	dev->ops.close(dev->priv);
 	if (dev->queues)
 		free(dev->queues);
@@ -345,9 +471,15 @@ int nfb_comp_count(const struct nfb_device *dev, const char *compatible)
 		return -1;
 
 	const void *fdt = nfb_get_fdt(dev);
+	const struct nfb_comp_index *index;
 	int node_offset;
 	int count = 0;
 
+	if (dev->comp_index) {
+		index = nfb_comp_index_find(dev, compatible);
+		return index ? index->count : 0;
+	}
+
 	fdt_for_each_compatible_node(fdt, node_offset, compatible) {
 		count++;
 	}
@@ -361,9 +493,17 @@ int nfb_comp_find(const struct nfb_device *dev, const char *compatible, unsigned
 		return -1;
 
 	const void *fdt = nfb_get_fdt(dev);
+	const struct nfb_comp_index *index_entry;
 	int node_offset;
 	unsigned count = 0;
 
+	if (dev->comp_index) {
+		index_entry = nfb_comp_index_find(dev, compatible);
+		if (index_entry == NULL || index >= (unsigned) index_entry->count)
+			return -FDT_ERR_NOTFOUND;
+		return index_entry->offsets[index];
+	}
+
 	fdt_for_each_compatible_node(fdt, node_offset, compatible) {
 		if (count == index)
 			return node_offset;
@@ -416,7 +556,33 @@ int nfb_comp_find_in_parent(const struct nfb_device *dev, const char *compatible
 		return -1;
 
 	const void *fdt = nfb_get_fdt(dev);
+	const struct nfb_comp_index *index_entry;
 	unsigned subtree_index = 0;
+	int depth = 0;
+	int end;
+	int i;
+
+	if (dev->comp_index && parent_offset >= 0) {
+		index_entry = nfb_comp_index_find(dev, compatible);
+		if (index_entry == NULL)
+			return -FDT_ERR_NOTFOUND;
+
+		/* The subtree ends with the next node at the same or upper level */
+		end = parent_offset;
+		do {
+			end = fdt_next_node(fdt, end, &depth);
+		} while (end >= 0 && depth > 0);
+
+		for (i = 0; i < index_entry->count; i++) {
+			if (index_entry->offsets[i] <= parent_offset)
+				continue;
+			if (end >= 0 && index_entry->offsets[i] >= end)
+				break;
+			if (subtree_index++ == index)
+				return index_entry->offsets[i];
+		}
+		return -FDT_ERR_NOTFOUND;
+	}
 
 	return find_in_subtree(fdt, parent_offset, compatible, index, &subtree_index);
 }
@@ -537,6 +703,13 @@ int nfb_comp_trylock(const struct nfb_comp *comp, uint32_t features, int timeout
 	if (!comp)
 		return -EINVAL;
 
+	/* The driver can sleep until the component is unlocked: don't poll it */
+	if (timeout != 0 && comp->dev->ops.comp_lock == nfb_base_comp_lock) {
+		ret = nfb_base_comp_lock_wait(comp, features, timeout);
+		if (ret != -ENOTTY)
+			return ret;
+	}
+
 	if (timeout > 0)
 		clock_gettime(CLOCK_MONOTONIC, &start);
 
@@ -595,6 +768,38 @@ int nfb_base_comp_lock(const struct nfb_comp *comp, uint32_t features)
 	return 1;
 }
 
+int nfb_base_comp_lock_wait(const struct nfb_comp *comp, uint32_t features, int timeout)
+{
+	struct nfb_lock_wait lock;
+	struct timespec start, end;
+	int64_t diff;
+
+	lock.path = comp->path;
+	lock.features = features;
+	lock.timeout = timeout;
+	lock.reserved = 0;
+
+	if (timeout > 0)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (ioctl(comp->dev->fd, NFB_LOCK_IOC_LOCK, &lock) == -1) {
+		if (errno == EBUSY && timeout != 0) {
+			return -ETIMEDOUT;
+		} else if (errno != EINTR) {
+			return -errno;
+		}
+
+		/* Interrupted: wait only for the rest of the timeout */
+		if (timeout > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			diff = (1000000000L * (end.tv_sec - start.tv_sec) + end.tv_nsec - start.tv_nsec) / 1000000L;
+			lock.timeout = diff < timeout ? timeout - diff : 0;
+		}
+	}
+
+	return 0;
+}
+
 void nfb_comp_unlock(const struct nfb_comp *comp, uint32_t features)
 {
 	if (!comp)
@@ -17,6 +17,15 @@
 
 struct ndp_queue;
 
+/*!
+ * \brief Index of FDT nodes with one compatible string
+ */
+struct nfb_comp_index {
+	const char *compatible;         /*!< Compatible string, points into the FDT */
+	int count;                      /*!< Number of nodes */
+	int *offsets;                   /*!< Node offsets in the FDT order */
+};
+
 /*!
  * \brief Structure for the NFB device
  */
@@ -29,6 +38,10 @@ struct nfb_device {
 	struct ndp_queue **queues;      /*!< Opened NDP queues pointers for poll function */
 	struct libnfb_ext_ops ops;
 	void *ext_lib;
+
+	struct nfb_comp_index *comp_index; /*!< Sorted by compatible, built in nfb_open; NULL if not available */
+	int comp_index_count;
+	int *comp_index_offsets;
 };
 
 /*!
@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * libnfb test - NDP v1 RX recovery from ring errors
+ *
+ * The NDP ioctls are served by a simulated channel: a malformed packet
+ * header (EBADMSG) and a packet behind the locked space (EPIPE) must
+ * restart the queue and the reception must continue exactly at the
+ * hardware pointer of the restarted subscription.
+ *
+ * Copyright (C) 2026 CESNET
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <numa.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <linux/nfb/ndp.h>
+#include <nfb/ndp.h>
+
+#include "../src/nfb.h"
+
+#include <netcope/ndp_base.h>
+
+#define RING_SIZE               (1 << 16)
+#define PKT_LEN                 64
+
+static struct {
+	unsigned char *buffer;
+	uint64_t hwptr;
+	uint64_t swptr;
+} chan;
+
+/* Replaces the libc ioctl for the queue code included above */
+int ioctl(int fd, unsigned long request, ...)
+{
+	va_list ap;
+	struct ndp_subscription_sync *sync;
+
+	(void) fd;
+
+	va_start(ap, request);
+	sync = va_arg(ap, struct ndp_subscription_sync *);
+	va_end(ap);
+
+	switch (request) {
+	case NDP_IOC_START:
+		/* Shared subscription starts at the current hardware pointer */
+		chan.swptr = chan.hwptr;
+		sync->hwptr = chan.hwptr;
+		sync->swptr = chan.swptr;
+		return 0;
+	case NDP_IOC_STOP:
+		return 0;
+	case NDP_IOC_SYNC:
+		chan.swptr = sync->swptr;
+		sync->hwptr = chan.hwptr;
+		return 0;
+	default:
+		errno = ENOTTY;
+		return -1;
+	}
+}
+
+static void ring_put(uint32_t seq)
+{
+	struct ndp_packethdr *hdr = (struct ndp_packethdr *) (chan.buffer + chan.hwptr);
+
+	hdr->packet_size = 8 + PKT_LEN;
+	hdr->header_size = 0;
+	memcpy(chan.buffer + chan.hwptr + 8, &seq, sizeof(seq));
+	chan.hwptr += ALIGN(8 + PKT_LEN, 8);
+}
+
+static void ring_put_bad(int error)
+{
+	struct ndp_packethdr *hdr = (struct ndp_packethdr *) (chan.buffer + chan.hwptr);
+
+	/* EBADMSG: zero packet size, EPIPE: packet longer than the published data */
+	hdr->packet_size = error == EBADMSG ? 0 : 0x3000;
+	hdr->header_size = 0;
+	chan.hwptr += ALIGN(8 + PKT_LEN, 8);
+}
+
+static int rx_expect(struct nc_ndp_queue *q, uint32_t seq, unsigned count)
+{
+	unsigned i, ret;
+	uint32_t rseq;
+	struct ndp_packet pkts[16];
+
+	ret = nc_ndp_v1_rx_burst_get(q, pkts, count);
+	if (ret != count) {
+		fprintf(stderr, "expected %u packets from %u, got %u\n", count, seq, ret);
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		memcpy(&rseq, pkts[i].data, sizeof(rseq));
+		if (pkts[i].data_length != PKT_LEN || rseq != seq + i) {
+			fprintf(stderr, "expected packet %u, got %u of length %u at offset %td\n",
+					seq + i, rseq, pkts[i].data_length, pkts[i].data - chan.buffer);
+			return -1;
+		}
+	}
+	nc_ndp_v1_rx_burst_put(q);
+	return 0;
+}
+
+static int test_recover(struct nc_ndp_queue *q, int error, uint32_t seq)
+{
+	unsigned i;
+	struct ndp_packet pkts[16];
+	struct ndp_queue_error_stats stats;
+	unsigned long long recovered = q->q->recover_count;
+
+	for (i = 0; i < 10; i++)
+		ring_put(seq + i);
+
+	/* Leave part of the locked data unread, the queue has a nonzero local offset */
+	if (rx_expect(q, seq, 4) || rx_expect(q, seq + 4, 3))
+		return -1;
+
+	ring_put_bad(error);
+	if (nc_ndp_v1_rx_burst_get(q, pkts, 16) != 0) {
+		fprintf(stderr, "burst over a corrupted header returned packets\n");
+		return -1;
+	}
+
+	ndp_queue_get_error_stats(q->q, &stats);
+	if (ndp_queue_get_error(q->q) != error || stats.recovered != recovered + 1) {
+		fprintf(stderr, "error %d not recovered\n", error);
+		return -1;
+	}
+
+	/* The corrupted data are dropped, new data continue at the restarted hwptr */
+	for (i = 0; i < 10; i++)
+		ring_put(seq + 100 + i);
+
+	if (rx_expect(q, seq + 100, 6) || rx_expect(q, seq + 106, 4))
+		return -1;
+
+	/* Everything read, the unlock must release exactly up to hwptr */
+	nc_ndp_v1_rx_unlock(q);
+	if (chan.swptr != chan.hwptr) {
+		fprintf(stderr, "released swptr %llu, expected %llu\n",
+				(unsigned long long) chan.swptr, (unsigned long long) chan.hwptr);
+		return -1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int ret;
+	struct ndp_queue ndp_q;
+	struct nc_ndp_queue q;
+
+	chan.buffer = malloc(RING_SIZE);
+	if (chan.buffer == NULL)
+		return EXIT_FAILURE;
+	memset(chan.buffer, 0, RING_SIZE);
+
+	memset(&ndp_q, 0, sizeof(ndp_q));
+	memset(&q, 0, sizeof(q));
+	q.q = &ndp_q;
+	q.fd = -1;
+	q.protocol = 1;
+	q.channel.type = NDP_CHANNEL_TYPE_RX;
+	q.buffer = chan.buffer;
+	q.size = RING_SIZE;
+
+	/* Data published before the start are not for this subscription */
+	ring_put(0xdead);
+
+	ret = nc_ndp_queue_start(&q);
+	if (ret == 0)
+		ret = test_recover(&q, EBADMSG, 0);
+	if (ret == 0)
+		ret = test_recover(&q, EPIPE, 1000);
+
+	free(chan.buffer);
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
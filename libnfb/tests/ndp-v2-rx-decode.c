@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * libnfb test - NDP v2 RX header decoders
+ *
+ * Runs the scalar and the AVX2 decoder on the same header and offset
+ * arrays and compares the decoded packets, burst lengths cover the
+ * partial vector tails. The decoding rate of both is printed too.
+ *
+ * Copyright (C) 2026 CESNET
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <numa.h>
+#include <sys/mman.h>
+
+#include <linux/nfb/ndp.h>
+#include <nfb/ndp.h>
+
+#include "../src/nfb.h"
+
+#include <netcope/ndp_base.h>
+
+#define TEST_SKIP               77
+
+#define TEST_ITEMS              1024
+#define TEST_BURST_MAX          67
+#define TEST_BUFFER_SIZE        (4 << 20)
+
+#define BENCH_BURST             32
+#define BENCH_ROUNDS            (1 << 21)
+
+#if defined(CONFIG_HAVE_MAVX2)
+
+typedef unsigned (*rx_burst_get_t)(void *priv, struct ndp_packet *packets, unsigned count);
+
+static struct ndp_v2_packethdr hdr[TEST_ITEMS + TEST_BURST_MAX];
+static struct ndp_v2_offsethdr off[TEST_ITEMS + TEST_BURST_MAX];
+
+static void queue_init(struct nc_ndp_queue *q, unsigned char *buffer)
+{
+	memset(q, 0, sizeof(*q));
+	q->buffer = buffer;
+	q->u.v2.hdr = hdr;
+	q->u.v2.off = off;
+	q->u.v2.rhp = 0;
+	/* Enough packets for the whole run, the decoders must not touch the controller */
+	q->u.v2.pkts_available = ~0u;
+}
+
+static void headers_fill(void)
+{
+	unsigned i;
+	unsigned header_size;
+
+	srand(0x4e4450);
+	for (i = 0; i < TEST_ITEMS + TEST_BURST_MAX; i++) {
+		header_size = rand() % 64;
+		hdr[i].header_size = header_size;
+		hdr[i].packet_size = header_size + 60 + rand() % 9000;
+		/* Upper flag bits are not a part of the flags returned to the user */
+		hdr[i].flags = rand() & 0xFF;
+		off[i].offset = (rand() % (TEST_BUFFER_SIZE / 64)) * 64;
+	}
+}
+
+static int packets_compare(const struct ndp_packet *a, const struct ndp_packet *b, unsigned count, unsigned pos)
+{
+	unsigned i;
+
+	for (i = 0; i < count; i++) {
+		if (a[i].data != b[i].data || a[i].header != b[i].header ||
+				a[i].data_length != b[i].data_length ||
+				a[i].header_length != b[i].header_length ||
+				a[i].flags != b[i].flags) {
+			fprintf(stderr, "packet %u differs: data %p/%p header %p/%p data_length %u/%u header_length %u/%u flags %u/%u\n",
+					pos + i, a[i].data, b[i].data, a[i].header, b[i].header,
+					a[i].data_length, b[i].data_length, a[i].header_length, b[i].header_length,
+					a[i].flags, b[i].flags);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int test_decode(unsigned char *buffer)
+{
+	unsigned count, pos, ret_scalar, ret_avx2;
+	struct nc_ndp_queue q_scalar, q_avx2;
+	struct ndp_packet pkts_scalar[TEST_BURST_MAX];
+	struct ndp_packet pkts_avx2[TEST_BURST_MAX];
+
+	for (count = 1; count <= TEST_BURST_MAX; count++) {
+		queue_init(&q_scalar, buffer);
+		queue_init(&q_avx2, buffer);
+
+		/* Each burst length is decoded from all positions mod 4 */
+		for (pos = 0; pos + count <= TEST_ITEMS; pos += count) {
+			memset(pkts_scalar, 0, sizeof(pkts_scalar));
+			memset(pkts_avx2, 0xA5, sizeof(pkts_avx2));
+
+			ret_scalar = nc_ndp_v2_rx_burst_get(&q_scalar, pkts_scalar, count);
+			ret_avx2 = nc_ndp_v2_rx_burst_get_avx2(&q_avx2, pkts_avx2, count);
+
+			if (ret_scalar != count || ret_avx2 != count) {
+				fprintf(stderr, "burst of %u at %u: scalar returned %u, AVX2 returned %u\n",
+						count, pos, ret_scalar, ret_avx2);
+				return -1;
+			}
+			if (packets_compare(pkts_scalar, pkts_avx2, count, pos))
+				return -1;
+
+			/* The decoder must not write behind the requested count */
+			if (count < TEST_BURST_MAX && pkts_avx2[count].data != (void *) 0xA5A5A5A5A5A5A5A5ull) {
+				fprintf(stderr, "burst of %u at %u: AVX2 wrote behind the burst\n", count, pos);
+				return -1;
+			}
+
+			if (q_scalar.u.v2.rhp != q_avx2.u.v2.rhp ||
+					q_scalar.u.v2.pkts_available != q_avx2.u.v2.pkts_available) {
+				fprintf(stderr, "burst of %u at %u: queue state differs\n", count, pos);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+static double bench(rx_burst_get_t get, unsigned char *buffer)
+{
+	unsigned i;
+	struct timespec start, end;
+	struct nc_ndp_queue q;
+	struct ndp_packet pkts[BENCH_BURST];
+	volatile uint64_t sum = 0;
+	double secs;
+
+	queue_init(&q, buffer);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		if (q.u.v2.rhp + BENCH_BURST > TEST_ITEMS)
+			q.u.v2.rhp = 0;
+		get(&q, pkts, BENCH_BURST);
+		sum += pkts[BENCH_BURST - 1].data_length;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	return (double) BENCH_ROUNDS * BENCH_BURST / secs / 1e6;
+}
+
+int main(void)
+{
+	int ret;
+	unsigned char *buffer;
+
+	if (!__builtin_cpu_supports("avx2")) {
+		printf("AVX2 not supported by the CPU, skipping\n");
+		return TEST_SKIP;
+	}
+
+	/* The decoders only compute pointers, the buffer is never touched */
+	buffer = mmap(NULL, TEST_BUFFER_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buffer == MAP_FAILED) {
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+
+	headers_fill();
+
+	ret = test_decode(buffer);
+	if (ret == 0) {
+		printf("scalar: %.1f Mpps\n", bench(nc_ndp_v2_rx_burst_get, buffer));
+		printf("AVX2:   %.1f Mpps\n", bench(nc_ndp_v2_rx_burst_get_avx2, buffer));
+	}
+
+	munmap(buffer, TEST_BUFFER_SIZE);
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#else
+
+int main(void)
+{
+	printf("libnfb built without CONFIG_HAVE_MAVX2, skipping\n");
+	return TEST_SKIP;
+}
+
+#endif
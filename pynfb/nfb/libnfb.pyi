@@ -1,5 +1,5 @@
 import fdt
-from collections.abc import Iterable
+from collections.abc import Iterable, Iterator
 from typing import Optional, Union, List, Tuple
 
 from . import eth as mod_eth
@@ -52,9 +52,20 @@ class NdpQueue:
     def read_stats(self) -> dict[str, int]: ...
     def reset_stats(self) -> None: ...
 
+class NdpBurst:
+    def release(self) -> None: ...
+    def __enter__(self) -> NdpBurst: ...
+    def __exit__(self, *args) -> None: ...
+    def __len__(self) -> int: ...
+    def __getitem__(self, index: int) -> Tuple[memoryview, memoryview, int]: ...
+    def __iter__(self) -> Iterator[Tuple[memoryview, memoryview, int]]: ...
+    def lengths(self) -> list[int]: ...
+    def flags(self) -> list[int]: ...
+
 class NdpQueueRx(NdpQueue):
     def recv(self, cnt: int = -1, timeout: float = 0, i: Optional[Union[int, List[int]]] = None) -> list[Tuple[bytes, int]]: ...
     def recvmsg(self, cnt: int = -1, timeout: float = 0, i: Optional[Union[int, List[int]]] = None) -> list[Tuple[Tuple[bytes, bytes, int], int]]: ...
+    def recv_burst(self, cnt: int = 64, timeout: Optional[float] = 0) -> NdpBurst: ...
 
 class NdpQueueTx(NdpQueue):
     def send(self, pkts: Union[bytes, List[bytes]], hdrs: Optional[Union[bytes, List[bytes]]] = None, flags: Optional[Union[int, List[int]]] = None, flush: bool = True) -> None: ...
@@ -1,17 +1,34 @@
 import sys
 import time
 import cython
+import warnings
 
 from itertools import islice
 from typing import Union, Optional, List, Tuple, Iterable
 
-from libc.stdlib cimport malloc
+from libc.stdlib cimport malloc, free
 from libc.stdint cimport uint8_t, uint16_t, uint32_t, uint64_t, int32_t, uintptr_t
 from libcpp cimport bool
 from libc.errno cimport EBUSY, ETIMEDOUT, EAGAIN
 
 from cpython.ref cimport PyObject
 from cpython.exc cimport PyErr_SetFromErrno
+from cpython.buffer cimport PyBuffer_FillInfo
+
+cdef extern from "Python.h":
+    # Export counters of the memoryview (see memoryobject.h): NdpBurst checks
+    # them to find out whether its views are referenced before releasing any.
+    ctypedef struct _PyManagedBufferObject:
+        Py_ssize_t exports
+    ctypedef struct PyMemoryViewObject:
+        _PyManagedBufferObject *mbuf
+        int flags
+        Py_ssize_t exports
+    int _Py_MEMORYVIEW_RELEASED
+
+
+cdef inline bint _view_released(view):
+    return (<PyMemoryViewObject *> <PyObject *> view).flags & _Py_MEMORYVIEW_RELEASED
 
 import fdt
 
@@ -643,9 +660,15 @@ cdef class NdpQueueRx(NdpQueue):
     """
 
     cdef libnetcope.nc_rxqueue *_nc_queue
+    cdef ndp_packet *_burst_pkts
+    cdef unsigned _burst_size
+    cdef NdpBurst _burst
 
     def __init__(self, nfb: Nfb, node, index):
         self._dir = 0
+        self._burst_pkts = NULL
+        self._burst_size = 0
+        self._burst = None
         NdpQueue.__init__(self, nfb, node, index)
         self._nc_queue = libnetcope.nc_rxqueue_open(self._handle._dev, nfb._fdt_path_offset(node))
         self._handle.add_close_cb(self._close_handle)
@@ -653,12 +676,21 @@ cdef class NdpQueueRx(NdpQueue):
     def __del__(self):
         self._close_handle()
 
+    def __dealloc__(self):
+        free(self._burst_pkts)
+
     def _close_handle(self):
+        self._burst_release(True)
         if self._nc_queue is not NULL:
             libnetcope.nc_rxqueue_close(self._nc_queue)
             self._nc_queue = NULL
         super()._close_handle()
 
+    def stop(self):
+        """ Stop the queue"""
+        self._burst_release()
+        super().stop()
+
     def _check_handle(self):
         super()._check_handle()
         if self._nc_queue is NULL:
@@ -700,16 +732,15 @@ cdef class NdpQueueRx(NdpQueue):
         }
 
     cdef _recvmsg(self, cnt: int = -1, timeout: int = 0):
-        cdef int l_pkt
-        cdef int l_hdr
+        cdef unsigned l_pkt
+        cdef unsigned l_hdr
         cdef int icnt
-        cdef unsigned char* c_pkt
-        cdef unsigned char* c_hdr
         cdef ndp_packet ndppkt[64]
         cdef list pkts
         cdef long long int to
 
         self._check_running()
+        self._burst_release()
 
         to = 0
         pkts = []
@@ -727,21 +758,11 @@ cdef class NdpQueueRx(NdpQueue):
             else:
                 to = 0
 
+                # Slicing the C pointer copies the data straight into the new bytes object
                 for i in range(icnt):
-                    # FIXME: check if zero-length malloc will be freed after conversion to bytes
                     l_pkt = ndppkt[i].data_length
-                    c_pkt = <unsigned char *> malloc(l_pkt)
-                    if c_pkt == NULL:
-                        raise MemoryError()
-                    memcpy(c_pkt, ndppkt[i].data, l_pkt)
-
                     l_hdr = ndppkt[i].header_length
-                    c_hdr = <unsigned char *> malloc(l_hdr)
-                    if c_hdr == NULL:
-                        raise MemoryError()
-                    memcpy(c_hdr, ndppkt[i].header, l_hdr)
-
-                    pkts.append((<bytes>c_pkt[:l_pkt], <bytes>c_hdr[:l_hdr], ndppkt[i].flags))
+                    pkts.append(((<char *>ndppkt[i].data)[:l_pkt], (<char *>ndppkt[i].header)[:l_hdr], ndppkt[i].flags))
 
                 if cnt != -1:
                     cnt -= icnt
@@ -749,6 +770,70 @@ cdef class NdpQueueRx(NdpQueue):
 
         return pkts
 
+    cdef _burst_release(self, bint force=False):
+        if self._burst is not None:
+            if force:
+                # The queue is being closed, the burst must be returned anyway
+                self._burst._drop_views()
+            else:
+                # Raises BufferError while the burst data are still referenced
+                self._burst._release_views()
+            self._burst._invalidate()
+            self._burst = None
+            if self._q is not NULL:
+                ndp_rx_burst_put(self._q)
+
+    def recv_burst(self, cnt: int = 64, timeout = 0) -> NdpBurst:
+        """
+        Receive a burst of messages without copying
+
+        Packets and headers of the returned burst are read-only memoryviews
+        pointing directly to the DMA buffer of the queue. They are valid only
+        until the burst is released, after that the hardware can overwrite
+        the data at any time. Use the burst as a context manager or call
+        :meth:`NdpBurst.release` explicitly; the next call of recv_burst
+        releases the previous burst too. The release raises BufferError
+        and keeps the burst untouched while some memoryview slice or other
+        buffer object still refers to the burst data. Closing the queue
+        returns the burst unconditionally.
+
+        :param cnt: Maximum number of messages in the burst.
+        :param timeout: Maximum time in secs to wait for at least one message. timeout == None means unlimited time.
+        :return: burst of messages, can be empty
+        """
+        cdef unsigned icnt
+        cdef long long int to
+
+        if cnt <= 0:
+            raise ValueError("cnt must be positive")
+
+        self._check_running()
+        self._burst_release()
+
+        # The packet descriptors are kept for the whole life of the queue
+        if self._burst_pkts is NULL or self._burst_size < cnt:
+            free(self._burst_pkts)
+            self._burst_size = 0
+            self._burst_pkts = <ndp_packet *> malloc(cnt * sizeof(ndp_packet))
+            if self._burst_pkts is NULL:
+                raise MemoryError()
+            self._burst_size = cnt
+
+        to = 0
+        timeout = int(timeout * 1000000000) if timeout is not None else None
+        while True:
+            icnt = ndp_rx_burst_get(self._q, self._burst_pkts, cnt)
+            if icnt != 0 or timeout == 0:
+                break
+            if timeout is not None:
+                if to == 0:
+                    to = time_ns() + timeout
+                elif to < time_ns():
+                    break
+
+        self._burst = NdpBurst._create(self, self._burst_pkts, icnt)
+        return self._burst
+
     def recv(self, cnt: int = -1, timeout = 0) -> List[bytes]:
         """
         Receive packets
@@ -778,6 +863,174 @@ cdef class NdpQueueRx(NdpQueue):
         return self._recvmsg(cnt, int(timeout * 1000000000) if timeout is not None else None)
 
 
+cdef class NdpBurstBuffer:
+    """
+    Read-only buffer of one packet or header in the :class:`NdpBurst`
+
+    Exports the queue DMA memory through the buffer protocol, so that the
+    burst knows whether some memoryview still refers to the data.
+    """
+
+    cdef NdpBurst _burst
+    cdef char *_data
+    cdef Py_ssize_t _len
+
+    def __init__(self):
+        raise TypeError("NdpBurstBuffer can be obtained only from NdpBurst")
+
+    @staticmethod
+    cdef NdpBurstBuffer _create(NdpBurst burst, unsigned char *data, Py_ssize_t length):
+        cdef NdpBurstBuffer buf = NdpBurstBuffer.__new__(NdpBurstBuffer)
+        buf._burst = burst
+        buf._data = <char *>data
+        buf._len = length
+        return buf
+
+    def __getbuffer__(self, Py_buffer *buffer, int flags):
+        self._burst._check_valid()
+        PyBuffer_FillInfo(buffer, self, self._data, self._len, 1, flags)
+        self._burst._exports += 1
+
+    def __releasebuffer__(self, Py_buffer *buffer):
+        self._burst._exports -= 1
+
+
+cdef class NdpBurst:
+    """
+    Burst of messages received by :meth:`NdpQueueRx.recv_burst`
+
+    Indexing and iteration yield tuples of (packet, packet_header, flags),
+    where packet and packet_header are read-only memoryviews of the queue
+    DMA buffer. The views are released together with the burst; the burst
+    can't be released while a slice of the views or other object created
+    from them still exists.
+    """
+
+    cdef NdpQueueRx _queue
+    cdef ndp_packet *_pkts
+    cdef unsigned _count
+    cdef list _msgs
+    cdef Py_ssize_t _exports
+
+    def __init__(self):
+        raise TypeError("NdpBurst can be obtained only from NdpQueueRx.recv_burst")
+
+    @staticmethod
+    cdef NdpBurst _create(NdpQueueRx queue, ndp_packet *pkts, unsigned count):
+        cdef NdpBurst burst = NdpBurst.__new__(NdpBurst)
+        burst._queue = queue
+        burst._pkts = pkts
+        burst._count = count
+        burst._msgs = [None] * count
+        burst._exports = 0
+        return burst
+
+    cdef bint _view_referenced(self, view):
+        """ Check whether something else than the burst refers to the data of its view """
+        cdef PyMemoryViewObject *mv = <PyMemoryViewObject *> <PyObject *> view
+        # Slices of the view share its managed buffer, which holds the export
+        if _view_released(view):
+            return mv.mbuf.exports != 0
+        return mv.exports != 0 or mv.mbuf.exports != 1
+
+    cdef _release_views(self):
+        cdef Py_ssize_t views = 0
+
+        # Check all the views first, a refused release keeps them usable
+        for msg in self._msgs:
+            if msg is None:
+                continue
+            for view in msg[:2]:
+                if self._view_referenced(view):
+                    raise BufferError("burst data are still referenced by a slice or other buffer")
+                if not _view_released(view):
+                    views += 1
+        if self._exports != views:
+            raise BufferError("burst data are still referenced by {} buffer(s)".format(self._exports - views))
+
+        for msg in self._msgs:
+            if msg is not None:
+                msg[0].release()
+                msg[1].release()
+        self._msgs = None
+
+    cdef _drop_views(self):
+        for msg in self._msgs:
+            if msg is None:
+                continue
+            for view in msg[:2]:
+                try:
+                    view.release()
+                except BufferError:
+                    # The view is exported further, reported below
+                    pass
+        self._msgs = None
+        if self._exports != 0:
+            warnings.warn("burst data are still referenced by {} buffer(s) while the queue is closed".format(self._exports), ResourceWarning)
+
+    cdef _invalidate(self):
+        self._queue = None
+        self._pkts = NULL
+        self._count = 0
+
+    cdef _check_valid(self):
+        if self._queue is None:
+            raise ValueError("burst is already released")
+
+    def release(self) -> None:
+        """ Return the buffers of all messages in the burst back to the queue"""
+        if self._queue is not None:
+            self._queue._burst_release()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.release()
+
+    def __len__(self):
+        return self._count
+
+    def __getitem__(self, index: int):
+        cdef ndp_packet *pkt
+        cdef Py_ssize_t i = index
+
+        self._check_valid()
+        if i < 0:
+            i += self._count
+        if i < 0 or i >= self._count:
+            raise IndexError("burst index out of range")
+
+        # The views are created once per message, only a view released by the user is replaced
+        msg = self._msgs[i]
+        if msg is not None and not _view_released(msg[0]) and not _view_released(msg[1]):
+            return msg
+
+        pkt = &self._pkts[i]
+        data, header = msg[:2] if msg is not None else (None, None)
+        if data is None or _view_released(data):
+            data = memoryview(NdpBurstBuffer._create(self, pkt.data, pkt.data_length))
+        if header is None or _view_released(header):
+            header = memoryview(NdpBurstBuffer._create(self, pkt.header, pkt.header_length))
+        msg = (data, header, pkt.flags)
+        self._msgs[i] = msg
+        return msg
+
+    def __iter__(self):
+        for i in range(self._count):
+            yield self[i]
+
+    def lengths(self) -> List[int]:
+        """ Get the packet lengths of all messages in the burst"""
+        self._check_valid()
+        return [self._pkts[i].data_length for i in range(self._count)]
+
+    def flags(self) -> List[int]:
+        """ Get the flags of all messages in the burst"""
+        self._check_valid()
+        return [self._pkts[i].flags for i in range(self._count)]
+
+
 cdef class NdpQueueTx(NdpQueue):
     """
     Object representing a queue for transmitting data over NDP
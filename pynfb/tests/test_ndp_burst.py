@@ -0,0 +1,189 @@
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Tests of the zero-copy NdpQueueRx.recv_burst on a libnfb-ext-python device
+#
+# Copyright (C) 2026 CESNET
+
+import pytest
+
+fdt = pytest.importorskip("fdt")
+ext = pytest.importorskip("nfb.ext.python")
+
+import nfb  # noqa: E402
+
+
+def make_dtb():
+    tree = fdt.FDT()
+    tree.add_item(fdt.PropStrings("compatible", "netcope,bus,mi"), "/firmware/mi_bus0")
+    tree.add_item(fdt.PropStrings("compatible", "netcope,dma_ctrl_ndp_rx"), "/firmware/mi_bus0/dma_ctrl_ndp_rx0")
+    tree.add_item(fdt.PropWords("reg", 0x0, 0x80), "/firmware/mi_bus0/dma_ctrl_ndp_rx0")
+    return tree.to_dtb(version=17)
+
+
+class FakeRxQueue(ext.AbstractNdpQueueRx):
+    def __init__(self):
+        self.pending = []
+        self.locked = None
+        self.puts = 0
+
+    def burst_get(self, count):
+        # libnfb keeps pointers to the returned bytes until burst_put
+        self.locked, self.pending = self.pending[:count], self.pending[count:]
+        return self.locked
+
+    def burst_put(self):
+        self.locked = None
+        self.puts += 1
+
+
+class FakeNfb(ext.AbstractNfb):
+    def __init__(self):
+        super().__init__(make_dtb())
+        self.rxq = FakeRxQueue()
+
+    def queue_open(self, index, dir, flags):
+        return self.rxq if dir == 0 else None
+
+    def read(self, bus_node, comp_node, offset, size):
+        return bytes(size)
+
+    def write(self, bus_node, comp_node, offset, data):
+        return len(data)
+
+
+@pytest.fixture
+def fake():
+    return FakeNfb()
+
+
+@pytest.fixture
+def dev(fake):
+    dev = nfb.open(fake.path())
+    yield dev
+    dev._close_handle()
+
+
+def msgs(count):
+    return [(bytes([i]) * (60 + i), bytes([0xF0 + i]) * 4, i) for i in range(count)]
+
+
+def test_recv_burst(fake, dev):
+    fake.rxq.pending = msgs(3)
+    q = dev.ndp.rx[0]
+
+    with q.recv_burst(cnt=8) as burst:
+        assert len(burst) == 3
+        assert burst.lengths() == [60, 61, 62]
+        assert burst.flags() == [0, 1, 2]
+        for (data, header, flags), (pkt, hdr, f) in zip(burst, msgs(3)):
+            assert data.readonly and header.readonly
+            assert bytes(data) == pkt and bytes(header) == hdr and flags == f
+        assert bytes(burst[-1][0]) == msgs(3)[2][0]
+        # The views are created only once per message
+        assert burst[-1] is burst[2]
+        with pytest.raises(IndexError):
+            burst[3]
+
+    assert fake.rxq.puts == 1
+
+    # Empty burst without timeout
+    assert len(q.recv_burst()) == 0
+
+
+def test_release_invalidates_views(fake, dev):
+    fake.rxq.pending = msgs(2)
+    burst = dev.ndp.rx[0].recv_burst()
+    data, header, _ = burst[0]
+
+    burst.release()
+    assert fake.rxq.puts == 1
+
+    with pytest.raises(ValueError):
+        bytes(data)
+    with pytest.raises(ValueError):
+        header[0]
+    with pytest.raises(ValueError):
+        burst[0]
+    with pytest.raises(ValueError):
+        burst.lengths()
+
+    # The second release does nothing
+    burst.release()
+    assert fake.rxq.puts == 1
+
+
+def test_release_refused_while_referenced(fake, dev):
+    fake.rxq.pending = msgs(2)
+    q = dev.ndp.rx[0]
+    burst = q.recv_burst()
+    data = burst[1][0]
+    part = data[10:20]
+
+    # The slice keeps the DMA memory exported, the burst can't be returned
+    with pytest.raises(BufferError):
+        burst.release()
+    with pytest.raises(BufferError):
+        q.recv_burst()
+    assert fake.rxq.puts == 0
+    assert bytes(part) == bytes([1]) * 10
+
+    # The refused release keeps the views usable
+    assert bytes(data) == msgs(2)[1][0]
+    assert burst[1][0] is data
+
+    del part
+    burst.release()
+    assert fake.rxq.puts == 1
+
+
+def test_next_burst_releases_previous(fake, dev):
+    fake.rxq.pending = msgs(4)
+    q = dev.ndp.rx[0]
+
+    first = q.recv_burst(cnt=2)
+    data = first[0][0]
+    second = q.recv_burst(cnt=2)
+
+    assert fake.rxq.puts == 1
+    with pytest.raises(ValueError):
+        first[0]
+    with pytest.raises(ValueError):
+        bytes(data)
+    assert [bytes(d) for d, _, _ in second] == [p for p, _, _ in msgs(4)[2:]]
+
+
+def test_close_releases_burst(fake, dev):
+    fake.rxq.pending = msgs(2)
+    q = dev.ndp.rx[0]
+    burst = q.recv_burst()
+    data = burst[0][0]
+
+    q.stop()
+    assert fake.rxq.puts == 1
+    with pytest.raises(ValueError):
+        bytes(data)
+
+    fake.rxq.pending = msgs(2)
+    burst = q.recv_burst()
+    data = burst[0][0]
+
+    dev._close_handle()
+    assert fake.rxq.puts == 2
+    with pytest.raises(ValueError):
+        burst[0]
+    with pytest.raises(ValueError):
+        bytes(data)
+
+
+def test_close_releases_referenced_burst(fake, dev):
+    fake.rxq.pending = msgs(2)
+    burst = dev.ndp.rx[0].recv_burst()
+    part = burst[0][0][1:3]
+
+    # Closing never fails, the burst is returned even when still referenced
+    with pytest.warns(ResourceWarning):
+        dev._close_handle()
+    assert fake.rxq.puts == 1
+    with pytest.raises(ValueError):
+        burst[0]
+    del part
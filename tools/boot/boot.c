@@ -37,6 +37,7 @@
 #define FLAG_QUIET      1
 #define FLAG_FORCE      2
 #define FLAG_BITSTREAM  4
+#define FLAG_DELTA      8
 
 enum fw_diff_values {
 	DIFF_SAME = 0,
@@ -83,6 +84,7 @@ void usage(const char *me)
 	printf("-l              Print list of available slots\n");
 	printf("-h              Print this help message\n");
 	printf("--force         Force writing bitstream to the card, USE WITH CAUTION!\n");
+	printf("--delta         Rewrite only the changed flash blocks and verify them\n");
 	printf("\n");
 	printf("Quick boot:\n");
 	printf("Boot the device from selected slot and check if the signature\n");
@@ -608,7 +610,9 @@ int do_write_with_dev(struct nfb_device *dev, int slot, const char *filename, co
 		pthread_create(&pt, NULL, show_progress, &ps);
 	}
 
-	ret = nfb_fw_load_ext_name(dev, slot, data, size, flags & FLAG_QUIET ? 0 : NFB_FW_LOAD_FLAG_VERBOSE, filename);
+	ret = nfb_fw_load_ext_name(dev, slot, data, size,
+			(flags & FLAG_QUIET ? 0 : NFB_FW_LOAD_FLAG_VERBOSE) |
+			(flags & FLAG_DELTA ? NFB_FW_LOAD_FLAG_DELTA : 0), filename);
 
 	if ((flags & FLAG_QUIET) == 0 ) {
 		ps.done = 1;
@@ -768,6 +772,7 @@ int main(int argc, char *argv[])
 	enum commands cmd = CMD_UNKNOWN;
 	const struct option long_options[] = {
 		{"force", no_argument, 0, 0},
+		{"delta", no_argument, 0, 0},
 		{0, 0, 0, 0}
 	};
 	int option_index = 0;
@@ -780,6 +785,8 @@ int main(int argc, char *argv[])
 		case 0:
 			if (!strcmp(long_options[option_index].name, "force")) {
 				flags |= FLAG_FORCE;
+			} else if (!strcmp(long_options[option_index].name, "delta")) {
+				flags |= FLAG_DELTA;
 			} else {
 				errx(-1, "Unknown long option");
 			}
@@ -20,6 +20,8 @@
 #include <nfb/ndp.h>
 #include <netcope/nccommon.h>
 
+#include "pcap.h"
+
 enum progress_type {
 	PT_NONE,
 	PT_LETTER,
@@ -86,6 +88,7 @@ struct ndp_mode_transmit_params {
 	unsigned long long mbps;           /*!< Replay packets at a given Mbps */
 	bool               multiple_pcaps; /*!< Controls whether PCAP file is specified for each thread with '%d' as thread_id*/
 	unsigned long      min_len;        /*!< Minimal allowed frame length that can be transferred. */
+	bool               hugepages;      /*!< Controls whether the PCAP cache is backed by hugepages */
 };
 
 /*!
@@ -94,6 +97,10 @@ struct ndp_mode_transmit_params {
 struct ndp_mode_receive_params {
 	int ts_mode;                /*!< Timestamp store mode, see TS_MODE_* in pcap.h for possible values */
 	unsigned int trim;          /*!< Packet trim mode. Maximum size of the saved packet. */
+	int writer_flags;           /*!< PCAP writer flags, see PCAP_WRITER_* in pcap.h */
+	unsigned long long rotate_size; /*!< Start new PCAP file after given number of bytes (0 = never) */
+	unsigned rotate_time;       /*!< Start new PCAP file after given number of seconds (0 = never) */
+	struct pcap_writer writer;  /*!< Buffered PCAP writer of this thread */
 };
 
 // Purposely not a power of 2 but a prime number to avoid
@@ -135,7 +135,7 @@ struct ndptool_module modules[] = {
 		.short_help = "Receive packets to file",
 		.print_help = ndp_mode_receive_print_help,
 		.init = ndp_mode_receive_init,
-		.args = "f:t:r:",
+		.args = "f:t:r:oS:T:",
 		.parse_opt = ndp_mode_receive_parseopt,
 		.check = ndp_mode_receive_check,
 		.run_single = ndp_mode_receive,
@@ -146,7 +146,7 @@ struct ndptool_module modules[] = {
 		.short_help = "Transmit packets from file",
 		.print_help = ndp_mode_transmit_print_help,
 		.init = ndp_mode_transmit_init,
-		.args = "f:l:s:L:Zm",
+		.args = "f:l:s:L:ZmH",
 		.parse_opt = ndp_mode_transmit_parseopt,
 		.check = ndp_mode_transmit_check,
 		.run_single = ndp_mode_transmit,
@@ -7,10 +7,15 @@
  *   Martin Spinler <spinler@cesnet.cz>
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "common.h"
 #include "pcap.h"
@@ -31,18 +36,20 @@ FILE *pcap_read_begin(const char *filename)
 	return f;
 }
 
+static const struct pcap_hdr_s pcap_file_hdr = {
+	.magic_number   = 0xa1b23c4d,
+	.version_major  = 2,
+	.version_minor  = 4,
+	.thiszone       = 0,
+	.sigfigs        = 0,
+	.snaplen        = 65535,
+	.network        = 1 /* LINKTYPE_ETHERNET */
+};
+
 FILE *pcap_write_begin(const char *filename)
 {
 	FILE *f;
-	struct pcap_hdr_s hdr = {
-		.magic_number   = 0xa1b23c4d,
-		.version_major  = 2,
-		.version_minor  = 4,
-		.thiszone       = 0,
-		.sigfigs        = 0,
-		.snaplen        = 65535,
-		.network        = 1 /* LINKTYPE_ETHERNET */
-	};
+	struct pcap_hdr_s hdr = pcap_file_hdr;
 
 	f = fopen(filename, "wb");
 	if (f == NULL) {
@@ -62,32 +69,38 @@ static inline uint32_t min(uint32_t a, uint32_t b)
 	return a < b ? a : b;
 }
 
-int pcap_write_packet(struct ndp_packet *pkt, FILE *file, int ts_mode, unsigned trim)
+static inline void pcap_fill_record(struct pcaprec_hdr_s *hdr, struct ndp_packet *pkt, int ts_mode, unsigned trim)
 {
 	struct timespec ts;
-	struct pcaprec_hdr_s hdr;
 
 	if (ts_mode == TS_MODE_SYSTEM) {
 		clock_gettime(CLOCK_REALTIME, &ts);
-		hdr.ts_sec = ts.tv_sec;
-		hdr.ts_nsec = ts.tv_nsec;
+		hdr->ts_sec = ts.tv_sec;
+		hdr->ts_nsec = ts.tv_nsec;
 	} else if (ts_mode >= 0) {
 		if ((unsigned) ts_mode + 64 > pkt->header_length * 8) {
 			warnx("Packet header is too short (%d bits) for specified timestamp "
 					"value offset (bits %d-%d)", pkt->header_length * 8, ts_mode, ts_mode + 63);
-			hdr.ts_sec = 0;
-			hdr.ts_nsec = 0;
+			hdr->ts_sec = 0;
+			hdr->ts_nsec = 0;
 		} else {
-			hdr.ts_sec = (*((uint64_t*)(pkt->header + ts_mode / 8 + 4))) >> (ts_mode % 8);
-			hdr.ts_nsec = (*((uint64_t*)(pkt->header + ts_mode / 8 + 0))) >> (ts_mode % 8);
+			hdr->ts_sec = (*((uint64_t*)(pkt->header + ts_mode / 8 + 4))) >> (ts_mode % 8);
+			hdr->ts_nsec = (*((uint64_t*)(pkt->header + ts_mode / 8 + 0))) >> (ts_mode % 8);
 		}
 	} else {
-		hdr.ts_sec = 0;
-		hdr.ts_nsec = 0;
+		hdr->ts_sec = 0;
+		hdr->ts_nsec = 0;
 	}
 
-	hdr.orig_len = pkt->data_length;
-	hdr.incl_len = min(pkt->data_length, trim);
+	hdr->orig_len = pkt->data_length;
+	hdr->incl_len = min(pkt->data_length, trim);
+}
+
+int pcap_write_packet(struct ndp_packet *pkt, FILE *file, int ts_mode, unsigned trim)
+{
+	struct pcaprec_hdr_s hdr;
+
+	pcap_fill_record(&hdr, pkt, ts_mode, trim);
 
 	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1) {
 		warn("Writing PCAP packet header failed");
@@ -114,3 +127,153 @@ int pcap_write_packet_burst(struct ndp_packet *pkts, unsigned pkt_count, FILE *f
 
 	return 0;
 }
+
+static int pcap_writer_write(struct pcap_writer *w, size_t len)
+{
+	ssize_t ret;
+	size_t done = 0;
+
+	while (done < len) {
+		ret = write(w->fd, w->buf + done, len - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			warn("Writing PCAP file '%s' failed", w->filename);
+			return -1;
+		}
+		done += ret;
+	}
+
+	w->file_size += len;
+	return 0;
+}
+
+/* Write out the buffer; with O_DIRECT only the aligned part, unless finishing the file */
+static int pcap_writer_flush(struct pcap_writer *w, int final)
+{
+	size_t len = w->buf_used;
+
+	if ((w->flags & PCAP_WRITER_DIRECT) && !final)
+		len &= ~(size_t) (PCAP_WRITER_ALIGN - 1);
+
+	if (len == 0)
+		return 0;
+
+	/* The unaligned tail of the file can't be written with O_DIRECT */
+	if ((w->flags & PCAP_WRITER_DIRECT) && final && (len % PCAP_WRITER_ALIGN)) {
+		if (fcntl(w->fd, F_SETFL, fcntl(w->fd, F_GETFL) & ~O_DIRECT)) {
+			warn("Disabling O_DIRECT on '%s' failed", w->filename);
+			return -1;
+		}
+	}
+
+	if (pcap_writer_write(w, len))
+		return -1;
+
+	w->buf_used -= len;
+	if (w->buf_used)
+		memmove(w->buf, w->buf + len, w->buf_used);
+	return 0;
+}
+
+static int pcap_writer_file_open(struct pcap_writer *w)
+{
+	int oflags = O_WRONLY | O_CREAT | O_TRUNC;
+	char *fn = NULL;
+
+	if (w->flags & PCAP_WRITER_DIRECT)
+		oflags |= O_DIRECT;
+
+	if (w->rotate_size || w->rotate_time) {
+		if (asprintf(&fn, "%s.%u", w->filename, w->file_index) < 0)
+			return -1;
+	}
+
+	w->fd = open(fn ? fn : w->filename, oflags, 0644);
+	if (w->fd < 0) {
+		warn("Could not open PCAP file '%s'", fn ? fn : w->filename);
+		free(fn);
+		return -1;
+	}
+	free(fn);
+
+	w->file_index++;
+	w->file_size = 0;
+	if (w->rotate_time)
+		w->file_start = time(NULL);
+
+	memcpy(w->buf + w->buf_used, &pcap_file_hdr, sizeof(pcap_file_hdr));
+	w->buf_used += sizeof(pcap_file_hdr);
+	return 0;
+}
+
+static int pcap_writer_file_close(struct pcap_writer *w)
+{
+	int ret;
+
+	ret = pcap_writer_flush(w, 1);
+	if (close(w->fd))
+		ret = -1;
+	w->fd = -1;
+	return ret;
+}
+
+int pcap_writer_open(struct pcap_writer *w, const char *filename, int flags,
+		unsigned long long rotate_size, unsigned rotate_time)
+{
+	memset(w, 0, sizeof(*w));
+	w->filename = filename;
+	w->flags = flags;
+	w->rotate_size = rotate_size;
+	w->rotate_time = rotate_time;
+
+	if (posix_memalign((void **) &w->buf, PCAP_WRITER_ALIGN, PCAP_WRITER_BUFFER_SIZE)) {
+		warnx("Could not allocate PCAP write buffer");
+		return -1;
+	}
+
+	if (pcap_writer_file_open(w)) {
+		free(w->buf);
+		return -1;
+	}
+
+	return 0;
+}
+
+int pcap_writer_burst(struct pcap_writer *w, struct ndp_packet *pkts, unsigned count, int ts_mode, unsigned trim)
+{
+	unsigned i;
+	struct pcaprec_hdr_s hdr;
+
+	/* Rotation is checked per burst, so the file limits are not exact */
+	if ((w->rotate_size && w->file_size + w->buf_used >= w->rotate_size) ||
+			(w->rotate_time && time(NULL) - w->file_start >= w->rotate_time)) {
+		if (pcap_writer_file_close(w) || pcap_writer_file_open(w))
+			return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		pcap_fill_record(&hdr, &pkts[i], ts_mode, trim);
+
+		if (w->buf_used + sizeof(hdr) + hdr.incl_len > PCAP_WRITER_BUFFER_SIZE) {
+			if (pcap_writer_flush(w, 0))
+				return -1;
+		}
+
+		memcpy(w->buf + w->buf_used, &hdr, sizeof(hdr));
+		memcpy(w->buf + w->buf_used + sizeof(hdr), pkts[i].data, hdr.incl_len);
+		w->buf_used += sizeof(hdr) + hdr.incl_len;
+	}
+
+	return 0;
+}
+
+int pcap_writer_close(struct pcap_writer *w)
+{
+	int ret;
+
+	ret = pcap_writer_file_close(w);
+	free(w->buf);
+	w->buf = NULL;
+	return ret;
+}
@@ -12,6 +12,7 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <time.h>
 
 struct pcap_hdr_s {
 	uint32_t magic_number;  /* magic number */
@@ -36,9 +37,40 @@ struct pcaprec_hdr_s {
 #define TS_MODE_HEADER (0)      /* Store timestamp obtained from packet header
                                    This value is zero bit offset of timestamp in NDP header */
 
+/* Buffered PCAP writer flags */
+#define PCAP_WRITER_DIRECT (1 << 0)     /* Bypass page cache (O_DIRECT) */
+
+#define PCAP_WRITER_BUFFER_SIZE (4 << 20)
+#define PCAP_WRITER_ALIGN 4096
+
+/*!
+ * \brief Buffered PCAP writer, one instance per receiving thread
+ *
+ * Records are assembled in a large aligned buffer, which is written
+ * to the file descriptor in a single syscall when full.
+ */
+struct pcap_writer {
+	const char *filename;       /*!< Base filename, <filename>.<index> is used with rotation */
+	int fd;
+	int flags;                  /*!< PCAP_WRITER_* flags */
+	unsigned char *buf;
+	size_t buf_used;
+
+	unsigned long long rotate_size; /*!< Start new file after given number of bytes (0 = never) */
+	unsigned rotate_time;       /*!< Start new file after given number of seconds (0 = never) */
+	unsigned long long file_size;
+	time_t file_start;
+	unsigned file_index;
+};
+
 FILE *pcap_read_begin(const char *filename);
 FILE *pcap_write_begin(const char *filename);
 int pcap_write_packet(struct ndp_packet *pkt, FILE *pcapfile, int ts_mode, unsigned trim);
 int pcap_write_packet_burst(struct ndp_packet *burst, unsigned burst_size, FILE *pcapfile, int ts_mode, unsigned trim);
 
+int pcap_writer_open(struct pcap_writer *w, const char *filename, int flags,
+		unsigned long long rotate_size, unsigned rotate_time);
+int pcap_writer_burst(struct pcap_writer *w, struct ndp_packet *pkts, unsigned count, int ts_mode, unsigned trim);
+int pcap_writer_close(struct pcap_writer *w);
+
 #endif /* NDPTOOL_PCAP_H */
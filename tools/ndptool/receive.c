@@ -9,8 +9,10 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
 #include <err.h>
+#include <limits.h>
 #include <numa.h>
 
 #include <nfb/nfb.h>
@@ -19,6 +21,9 @@
 #include "common.h"
 #include "pcap.h"
 
+/* Rotation size is given in MiB and kept in bytes */
+#define ROTATE_SIZE_MAX (ULLONG_MAX >> 20)
+
 static int ndp_mode_receive_prepare(struct ndp_tool_params *p);
 static int ndp_mode_receive_loop(struct ndp_tool_params *p);
 static int ndp_mode_receive_exit(struct ndp_tool_params *p);
@@ -83,10 +88,10 @@ static int ndp_mode_receive_prepare(struct ndp_tool_params *p)
 		goto err_common_prepare;
 	}
 
-	p->pcap_file = pcap_write_begin(p->pcap_filename);
-	if (p->pcap_file == NULL) {
+	ret = pcap_writer_open(&p->mode.receive.writer, p->pcap_filename, p->mode.receive.writer_flags,
+			p->mode.receive.rotate_size, p->mode.receive.rotate_time);
+	if (ret) {
 		warnx("initializing PCAP file '%s' failed", p->pcap_filename);
-		ret = -1;
 		goto err_init_pcap_file;
 	}
 
@@ -95,8 +100,7 @@ static int ndp_mode_receive_prepare(struct ndp_tool_params *p)
 	return 0;
 
 	/* Error handling */
-	fclose(p->pcap_file);
-	p->pcap_file = NULL;
+	pcap_writer_close(&p->mode.receive.writer);
 err_init_pcap_file:
 	ndp_mode_common_close(p, 1, 0);
 err_common_prepare:
@@ -107,8 +111,7 @@ static int ndp_mode_receive_exit(struct ndp_tool_params *p)
 {
 	gettimeofday(&p->si.endTime, NULL);
 	ndp_mode_common_close(p, 1, 0);
-	fclose(p->pcap_file);
-	return 0;
+	return pcap_writer_close(&p->mode.receive.writer);
 }
 
 static int ndp_mode_receive_loop(struct ndp_tool_params *p)
@@ -147,7 +150,7 @@ static int ndp_mode_receive_loop(struct ndp_tool_params *p)
 			continue;
 		}
 
-		ret = pcap_write_packet_burst(packets, cnt, p->pcap_file, p->mode.receive.ts_mode, p->mode.receive.trim);
+		ret = pcap_writer_burst(&p->mode.receive.writer, packets, cnt, p->mode.receive.ts_mode, p->mode.receive.trim);
 		if (ret) {
 			ndp_rx_burst_put(rx);
 			return ret;
@@ -163,6 +166,9 @@ int ndp_mode_receive_init(struct ndp_tool_params *p)
 {
 	p->mode.receive.ts_mode = TS_MODE_NONE;
 	p->mode.receive.trim = (unsigned)-1;
+	p->mode.receive.writer_flags = 0;
+	p->mode.receive.rotate_size = 0;
+	p->mode.receive.rotate_time = 0;
 	return 0;
 }
 
@@ -173,11 +179,16 @@ void ndp_mode_receive_print_help()
 	printf("  -t timestamp  Timestamp source for PCAP packet header: (system, header:X)\n");
 	printf("                (X is bit offset in NDP header of 64b timestamp value)\n");
 	printf("  -r trim       Maximum number of bytes per packet to save\n");
+	printf("  -o            Write PCAP file with O_DIRECT (bypass page cache)\n");
+	printf("  -S size       Start new PCAP file <file>.<N> after <size> MiB\n");
+	printf("  -T seconds    Start new PCAP file <file>.<N> after <seconds>\n");
 }
 
 int ndp_mode_receive_parseopt(struct ndp_tool_params *p, int opt, char *optarg,
 		int option_index __attribute__((unused)))
 {
+	unsigned long ulparam;
+
 	switch (opt) {
 	case 'f':
 		p->pcap_filename = optarg;
@@ -198,6 +209,25 @@ int ndp_mode_receive_parseopt(struct ndp_tool_params *p, int opt, char *optarg,
 				errx(-1, "Wrong value for parameter -r");
 		}
 		break;
+	case 'o':
+		p->mode.receive.writer_flags |= PCAP_WRITER_DIRECT;
+		break;
+	case 'S':
+		/* strtoull silently negates "-N" and saturates on overflow */
+		if (strchr(optarg, '-') || nc_strtoull(optarg, &p->mode.receive.rotate_size) ||
+				p->mode.receive.rotate_size == 0 || p->mode.receive.rotate_size > ROTATE_SIZE_MAX) {
+			errx(-1, "Wrong value for parameter -S, expected 1 to %llu MiB", ROTATE_SIZE_MAX);
+		}
+		p->mode.receive.rotate_size <<= 20;
+		break;
+	case 'T':
+		/* sscanf and strtoul silently wrap "-N" */
+		if (strchr(optarg, '-') || nc_strtoul(optarg, &ulparam) ||
+				ulparam == 0 || ulparam > UINT_MAX) {
+			errx(-1, "Wrong value for parameter -T, expected 1 to %u seconds", UINT_MAX);
+		}
+		p->mode.receive.rotate_time = ulparam;
+		break;
 	default:
 		return -1;
 	}
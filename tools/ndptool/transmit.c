@@ -8,9 +8,15 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <numa.h>
 
@@ -20,18 +26,24 @@
 #include "pcap.h"
 
 static const unsigned DEFAULT_CACHE_CAPACITY = 1024;
+static const size_t HUGEPAGE_SIZE = 2 << 20;
 
+/* Packed index of packet records in the loaded PCAP file */
 struct pcap_cache {
 	size_t                  capacity;
 	size_t                  items;
-	unsigned char           **packets;
-	size_t                  *sizes;
+	uint64_t                *offsets;
+	uint32_t                *sizes;
 	size_t                  offset;
 };
 
 struct pcap_src {
 	bool                    is_cached;
-	FILE                    *file;
+	unsigned char           *data;          /* PCAP file: NUMA local copy or file mapping */
+	size_t                  size;
+	size_t                  map_size;
+	size_t                  pos;            /* not cached: offset of the next record */
+	uint64_t                *burst;         /* data offsets of packets in current burst */
 	unsigned                loops;
 	unsigned                current_loop;
 	struct pcap_cache       cache;
@@ -46,7 +58,7 @@ static void pcap_src_close(struct pcap_src *src);
 static int pcap_src_burst_fill_meta(struct pcap_src *src, struct ndp_packet *packets, unsigned len);
 static int pcap_src_burst_fill_data(struct pcap_src *src, struct ndp_packet *packets, unsigned len);
 
-static int pcap_cache_create(struct pcap_cache *cache, FILE *sourcefile);
+static int pcap_cache_create(struct pcap_cache *cache, struct pcap_src *src);
 static void pcap_cache_destroy(struct pcap_cache *cache);
 
 int ndp_mode_transmit(struct ndp_tool_params *p)
@@ -225,6 +237,7 @@ int ndp_mode_transmit_init(struct ndp_tool_params *p)
 	p->mode.transmit.mbps = 0;
 	p->mode.transmit.min_len = 0;
 	p->mode.transmit.multiple_pcaps = false;
+	p->mode.transmit.hugepages = false;
 	return 0;
 }
 
@@ -233,7 +246,8 @@ void ndp_mode_transmit_print_help()
 	printf("Transmit parameters:\n");
 	printf("  -f file       Read data from PCAP file <file>\n");
 	printf("  -l loops      Loop over the PCAP file <loops> times (0 for forever)\n");
-	printf("  -Z            Do not preload file in cache (slower, consumes less memory)\n");
+	printf("  -Z            Do not preload file in cache (stream from page cache, consumes less memory)\n");
+	printf("  -H            Preload file to hugepages\n");
 	printf("  -m            Load PCAP file for each thread. -f parameter should contain %%t for thread_id or %%d fo dma_id\n");
 	printf("  -s Mbps       Replay packets at a given speed (deprecated, --speed long opt should be used instead)\n");
 	printf("  -L bytes      Minimal allowed frame length\n");
@@ -265,6 +279,9 @@ int ndp_mode_transmit_parseopt(struct ndp_tool_params *p, int opt, char *optarg,
 	case 'm':
 		p->mode.transmit.multiple_pcaps = true;
 		break;
+	case 'H':
+		p->mode.transmit.hugepages = true;
+		break;
 	case 's':
 		if (nc_strtoull(optarg, &p->mode.transmit.mbps))
 			errx(-1, "Cannot parse mbps parameter");
@@ -287,29 +304,154 @@ int ndp_mode_transmit_check(struct ndp_tool_params *p)
 	return 0;
 }
 
+static void *pcap_src_alloc(size_t *size, int numa_node, bool hugepages)
+{
+	void *ptr = MAP_FAILED;
+	size_t alloc_size = *size;
+
+	if (hugepages) {
+		alloc_size = (alloc_size + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+		ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (ptr == MAP_FAILED)
+			warnx("no free hugepages for PCAP cache, using transparent hugepages");
+	}
+
+	if (ptr == MAP_FAILED) {
+		ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+			return NULL;
+		if (hugepages)
+			madvise(ptr, alloc_size, MADV_HUGEPAGE);
+	}
+
+	/* Place the cache on the node of the TX queue before the pages are touched */
+	if (numa_node >= 0 && numa_available() >= 0)
+		numa_tonode_memory(ptr, alloc_size, numa_node);
+
+	*size = alloc_size;
+	return ptr;
+}
+
+static int pcap_src_load(struct pcap_src *src, int fd, int numa_node, bool hugepages)
+{
+	ssize_t ret;
+	size_t done = 0;
+
+	src->map_size = src->size;
+	src->data = pcap_src_alloc(&src->map_size, numa_node, hugepages);
+	if (src->data == NULL) {
+		warn("cannot allocate cache memory");
+		return -1;
+	}
+
+	while (done < src->size) {
+		ret = read(fd, src->data + done, src->size - done);
+		if (ret <= 0) {
+			if (ret < 0 && errno == EINTR)
+				continue;
+			warn("error during reading PCAP file to cache");
+			munmap(src->data, src->map_size);
+			return -1;
+		}
+		done += ret;
+	}
+	return 0;
+}
+
 static int pcap_src_open(struct ndp_tool_params *params, struct pcap_src *src)
 {
+	int fd;
+	struct stat st;
+
+	memset(src, 0, sizeof(*src));
 	src->is_cached = params->mode.transmit.do_cache;
-	src->file = pcap_read_begin(params->pcap_filename);
 	src->loops = params->mode.transmit.loops;
 	src->current_loop = 1;
+	src->pos = sizeof(struct pcap_hdr_s);
 
-	if (!src->file) {
-		warnx("cannot open PCAP file for reading");
+	src->burst = malloc(sizeof(*src->burst) * TX_BURST);
+	if (src->burst == NULL) {
+		warn("cannot allocate burst memory");
 		return -1;
 	}
 
+	fd = open(params->pcap_filename, O_RDONLY);
+	if (fd < 0) {
+		warn("cannot open PCAP file for reading");
+		goto err_open;
+	}
+
+	if (fstat(fd, &st)) {
+		warn("cannot get size of PCAP file");
+		goto err_stat;
+	}
+
+	src->size = st.st_size;
+	if (src->size < sizeof(struct pcap_hdr_s)) {
+		warnx("Could not read PCAP header from '%s'", params->pcap_filename);
+		goto err_stat;
+	}
+
 	if (src->is_cached) {
-		return pcap_cache_create(&src->cache, src->file);
+		if (pcap_src_load(src, fd, ndp_queue_get_numa_node(params->tx), params->mode.transmit.hugepages))
+			goto err_load;
+		if (pcap_cache_create(&src->cache, src))
+			goto err_cache_create;
+	} else {
+		/* Stream the file through the page cache, no preload */
+		src->map_size = src->size;
+		src->data = mmap(NULL, src->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (src->data == MAP_FAILED) {
+			warn("cannot map PCAP file");
+			goto err_load;
+		}
+		madvise(src->data, src->map_size, MADV_SEQUENTIAL);
 	}
 
+	close(fd);
 	return 0;
+
+err_cache_create:
+	munmap(src->data, src->map_size);
+err_load:
+err_stat:
+	close(fd);
+err_open:
+	free(src->burst);
+	return -1;
 }
 
-static int pcap_src_burst_fill_meta(struct pcap_src *src, struct ndp_packet *packets, unsigned cnt)
+/*
+ * Get the next record of the not cached source, returns 0 at the end of file
+ * and -1 on a truncated record, which also becomes the new end of file
+ */
+static inline int pcap_src_next(struct pcap_src *src, uint64_t *offset, uint32_t *size)
 {
 	struct pcaprec_hdr_s phdr;
-	int ret;
+
+	if (src->pos + sizeof(phdr) > src->size)
+		return 0;
+
+	/* Records follow each other without any alignment */
+	memcpy(&phdr, src->data + src->pos, sizeof(phdr));
+	if (src->pos + sizeof(phdr) + phdr.incl_len > src->size) {
+		warnx("premature EOF, PCAP contains packet header but not enough data");
+		src->size = src->pos;
+		return -1;
+	}
+
+	*offset = src->pos + sizeof(phdr);
+	*size = phdr.incl_len;
+	src->pos = *offset + phdr.incl_len;
+	return 1;
+}
+
+static int pcap_src_burst_fill_meta(struct pcap_src *src, struct ndp_packet *packets, unsigned cnt)
+{
+	unsigned i;
+	uint32_t size;
 
 	if (cnt == 0)
 		return 0;
@@ -328,153 +470,108 @@ static int pcap_src_burst_fill_meta(struct pcap_src *src, struct ndp_packet *pac
 			cnt = src->cache.items - src->cache.offset;
 		}
 
-		for (unsigned i = 0; i < cnt; i++) {
+		for (i = 0; i < cnt; i++) {
+			src->burst[i] = src->cache.offsets[src->cache.offset + i];
 			packets[i].data_length = src->cache.sizes[src->cache.offset + i];
 		}
 
 		return cnt;
 	} else {
-		ret = fread(&phdr, sizeof(phdr), 1, src->file);
-		if (ret == 1) {
-			packets[0].data_length = phdr.incl_len;
-			return 1;
-		}
-
-		if (feof(src->file)) {
-			if (src->loops == 0 || src->current_loop < src->loops) {
-				ret = fseek(src->file, sizeof(struct pcap_hdr_s), SEEK_SET);
-				if (ret < 0) {
-					warn("error occured during file rewinding");
-					return 0;
-				}
-				ret = fread(&phdr, sizeof(phdr), 1, src->file);
-				if (ret != 1) {
-					warn("even repeated PCAP file read failed, baling out");
-					return 0;
-				}
+		for (i = 0; i < cnt; i++) {
+			if (pcap_src_next(src, &src->burst[i], &size) <= 0) {
+				/* End of file: rewind only at the start of a burst */
+				if (i > 0 || src->pos == sizeof(struct pcap_hdr_s) ||
+						(src->loops != 0 && src->current_loop >= src->loops))
+					break;
 
 				src->current_loop++;
-				packets[0].data_length = phdr.incl_len;
-				return 1;
-			} else {
-				return 0;
+				src->pos = sizeof(struct pcap_hdr_s);
+				if (pcap_src_next(src, &src->burst[i], &size) <= 0)
+					break;
 			}
-		} else {
-			warn("error occured during reading PCAP file");
-			return 0;
+			packets[i].data_length = size;
 		}
+		return i;
 	}
 }
 
 static int pcap_src_burst_fill_data(struct pcap_src *src, struct ndp_packet *packets, unsigned cnt)
 {
-	int ret;
-
 	if (cnt == 0)
 		return 0;
 
-	if (src->is_cached) {
-		for (unsigned i = 0; i < cnt; i++) {
-			memcpy(packets[i].data, src->cache.packets[src->cache.offset + i], packets[i].data_length);
-		}
-		src->cache.offset += cnt;
-		return cnt;
-	} else {
-		ret = fread(packets[0].data, packets[0].data_length, 1, src->file);
-		if (ret == 0) {
-			if (feof(src->file)) {
-				warnx("premature EOF, PCAP contains packet header but not enough data");
-			} else {
-				warn("error occured during reading packet data from PCAP");
-			}
-		}
-		return ret;
+	for (unsigned i = 0; i < cnt; i++) {
+		memcpy(packets[i].data, src->data + src->burst[i], packets[i].data_length);
 	}
+
+	if (src->is_cached)
+		src->cache.offset += cnt;
+	return cnt;
 }
 
 static void pcap_src_close(struct pcap_src *src)
 {
-	fclose(src->file);
+	munmap(src->data, src->map_size);
 	if (src->is_cached)
 		pcap_cache_destroy(&src->cache);
+	free(src->burst);
 }
 
-static int pcap_cache_create(struct pcap_cache *cache, FILE *sourcefile)
+static int pcap_cache_create(struct pcap_cache *cache, struct pcap_src *src)
 {
-	struct pcaprec_hdr_s phdr;
-	void * ptr = NULL;
+	int ret;
+	void *ptr;
+	uint32_t size;
+	uint64_t offset;
 
 	cache->capacity = DEFAULT_CACHE_CAPACITY;
 	cache->items = 0;
 	cache->offset = 0;
-	cache->packets = malloc(sizeof(unsigned char *) * cache->capacity);
-	cache->sizes = malloc(sizeof(size_t) * cache->capacity);
+	cache->offsets = malloc(sizeof(*cache->offsets) * cache->capacity);
+	cache->sizes = malloc(sizeof(*cache->sizes) * cache->capacity);
 
-	if (cache->packets == NULL || cache->sizes == NULL) {
+	if (cache->offsets == NULL || cache->sizes == NULL) {
 		warn("cannot allocate cache memory");
-		goto err_init_malloc;
+		goto err_resize_malloc;
 	}
 
-	while (fread(&phdr, sizeof(phdr), 1, sourcefile) == 1) {
-		cache->sizes[cache->items] = phdr.incl_len;
-		cache->packets[cache->items] = malloc(phdr.incl_len);
-		if (cache->packets[cache->items] == NULL) {
-			warn("cannot allocate memory for packet %zd in cache", cache->items);
-			goto err_packet_malloc;
-		}
-		if (fread(cache->packets[cache->items], phdr.incl_len, 1, sourcefile) != 1) {
-			warn("error during reading packet %zd data from PCAP file to cache", cache->items);
-			goto err_packet_read;
-		}
-
-		cache->items++;
-
+	/* Build the index in one pass over the loaded file */
+	while ((ret = pcap_src_next(src, &offset, &size)) > 0) {
 		if (cache->items == cache->capacity) {
 			cache->capacity *= 2;
-			ptr = cache->packets;
-			cache->packets = realloc(cache->packets, sizeof(unsigned char *) * cache->capacity);
-			if (cache->packets == NULL) {
-				warn("failed to reallocate memory for packet data");
+			ptr = realloc(cache->offsets, sizeof(*cache->offsets) * cache->capacity);
+			if (ptr == NULL) {
+				warn("failed to reallocate memory for packet offsets");
 				goto err_resize_malloc;
 			}
-			ptr = cache->sizes;
-			cache->sizes = realloc(cache->sizes, sizeof(size_t) * cache->capacity);
-			if (cache->sizes == NULL) {
+			cache->offsets = ptr;
+			ptr = realloc(cache->sizes, sizeof(*cache->sizes) * cache->capacity);
+			if (ptr == NULL) {
 				warn("failed to reallocate memory for packet sizes");
 				goto err_resize_malloc;
 			}
-			ptr = NULL;
+			cache->sizes = ptr;
 		}
-	}
 
-	if (feof(sourcefile)) {
-		return 0;
-	} else {
-		warn("error during reading packet %zd header from PCAP file to cache", cache->items);
-		goto err_ferror;
+		cache->offsets[cache->items] = offset;
+		cache->sizes[cache->items] = size;
+		cache->items++;
 	}
 
+	/* Cached transmission refuses a truncated file, same as before the preload */
+	if (ret < 0)
+		goto err_resize_malloc;
+
+	return 0;
+
 err_resize_malloc:
-	free(ptr);
-err_packet_read:
-	free(cache->packets[cache->items]);
-err_ferror:
-err_packet_malloc:
-	for (unsigned i = 0; i < cache->items; i++) {
-		free(cache->packets[i]);
-	}
-err_init_malloc:
 	free(cache->sizes);
-	free(cache->packets);
-
+	free(cache->offsets);
 	return -1;
 }
 
 static void pcap_cache_destroy(struct pcap_cache *cache)
 {
-	for (unsigned i = 0; i < cache->offset; i++) {
-		free(cache->packets[i]);
-	}
 	free(cache->sizes);
-	free(cache->packets);
+	free(cache->offsets);
 }